@@ -0,0 +1,61 @@
+#pragma once
+
+#include "constants.h"
+
+class aabb {
+    public:
+        interval x, y, z;
+
+        aabb() {} // default aabb is empty, since intervals are empty by default
+
+        aabb(const interval& x, const interval& y, const interval& z) : x(x), y(y), z(z) {}
+
+        aabb(const point3& a, const point3& b) {
+            // treat the two points a and b as extrema for the bounding box, so we don't
+            // require a particular minimum/maximum coordinate order
+            x = (a[0] <= b[0]) ? interval(a[0], b[0]) : interval(b[0], a[0]);
+            y = (a[1] <= b[1]) ? interval(a[1], b[1]) : interval(b[1], a[1]);
+            z = (a[2] <= b[2]) ? interval(a[2], b[2]) : interval(b[2], a[2]);
+        }
+
+        aabb(const aabb& box0, const aabb& box1) {
+            x = interval(box0.x, box1.x);
+            y = interval(box0.y, box1.y);
+            z = interval(box0.z, box1.z);
+        }
+
+        const interval& axis_interval(int n) const {
+            if (n == 1) return y;
+            if (n == 2) return z;
+            return x;
+        }
+
+        bool is_empty() const {
+            return x.min > x.max || y.min > y.max || z.min > z.max;
+        }
+
+        bool hit(const ray& r, interval ray_t) const {
+            // slab test: clip the ray interval against the three pairs of axis-aligned planes,
+            // using the ray's precomputed reciprocal direction and sign bits to pick the near
+            // and far plane without comparing. A box may be flat along an axis (a planar mesh),
+            // so touching slabs still count as a hit and the far plane is slightly widened.
+            const point3& ray_orig = r.origin();
+            const vec3& inv_dir = r.inv_direction();
+
+            for (int axis = 0; axis < 3; axis++) {
+                const interval& ax = axis_interval(axis);
+                const bool negative = r.sign(axis);
+
+                auto t0 = ((negative ? ax.max : ax.min) - ray_orig[axis]) * inv_dir[axis];
+                auto t1 = ((negative ? ax.min : ax.max) - ray_orig[axis]) * inv_dir[axis];
+                t1 *= 1 + 4 * std::numeric_limits<double>::epsilon();
+
+                if (t0 > ray_t.min) ray_t.min = t0;
+                if (t1 < ray_t.max) ray_t.max = t1;
+
+                if (ray_t.max < ray_t.min)
+                    return false;
+            }
+            return true;
+        }
+};
@@ -0,0 +1,213 @@
+#pragma once
+
+#include "render.h"
+#include "options.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct camera_keyframe {
+    double time;
+    point3 lookfrom;
+    point3 lookat;
+    double vfov;
+};
+
+class camera_path {
+    // piecewise-linear camera animation through a list of keyframes
+
+    public:
+        std::vector<camera_keyframe> keys;
+
+        static camera_path load(const std::string& path) {
+            // one keyframe per line: time  fromx fromy fromz  atx aty atz  vfov ('#' starts a comment)
+            std::ifstream in(path);
+            if (!in)
+                throw std::runtime_error("cannot open camera path " + path);
+
+            camera_path result;
+            std::string line;
+            int line_number = 0;
+            while (std::getline(in, line)) {
+                line_number++;
+                line = line.substr(0, line.find('#'));
+                if (line.find_first_not_of(" \t\r") == std::string::npos)
+                    continue;
+
+                std::istringstream fields(line);
+                camera_keyframe k;
+                if (!(fields >> k.time >> k.lookfrom[0] >> k.lookfrom[1] >> k.lookfrom[2]
+                             >> k.lookat[0] >> k.lookat[1] >> k.lookat[2] >> k.vfov))
+                    throw std::runtime_error(path + ":" + std::to_string(line_number) + ": bad keyframe");
+                if (!result.keys.empty() && k.time < result.keys.back().time)
+                    throw std::runtime_error(path + ":" + std::to_string(line_number) + ": keyframes out of order");
+                result.keys.push_back(k);
+            }
+
+            if (result.keys.empty())
+                throw std::runtime_error(path + ": no keyframes");
+            return result;
+        }
+
+        camera_keyframe at(double time) const {
+            if (time <= keys.front().time)
+                return keys.front();
+            if (time >= keys.back().time)
+                return keys.back();
+
+            size_t i = 1;
+            while (keys[i].time < time)
+                i++;
+            const auto& a = keys[i - 1];
+            const auto& b = keys[i];
+            double s = (b.time > a.time) ? (time - a.time) / (b.time - a.time) : 1.0;
+
+            return { time,
+                     (1 - s) * a.lookfrom + s * b.lookfrom,
+                     (1 - s) * a.lookat + s * b.lookat,
+                     (1 - s) * a.vfov + s * b.vfov };
+        }
+
+        camera_keyframe frame(int index, int frame_count) const {
+            // frame_count <= 0 renders the keyframes themselves, one frame each; otherwise the
+            // frames are spread evenly from the first to the last keyframe
+            if (frame_count <= 0)
+                return keys[index];
+            if (frame_count == 1)
+                return keys.front();
+            double t0 = keys.front().time;
+            double t1 = keys.back().time;
+            return at(t0 + (t1 - t0) * index / (frame_count - 1));
+        }
+
+        int count(int frame_count) const {
+            return frame_count <= 0 ? int(keys.size()) : frame_count;
+        }
+};
+
+inline std::string frame_filename(const std::string& pattern, int index) {
+    // pattern such as "frame_%04d.ppm" (see find_frame_conversion); without a conversion the
+    // index is appended
+    size_t begin, end;
+    int width;
+    if (!find_frame_conversion(pattern, begin, end, width)) {
+        auto dot = pattern.rfind('.');
+        auto stem = pattern.substr(0, dot);
+        auto ext = dot == std::string::npos ? std::string() : pattern.substr(dot);
+        return stem + "_" + std::to_string(index) + ext;
+    }
+    auto number = std::to_string(index);
+    if (number.size() < size_t(width))
+        number.insert(0, width - number.size(), '0');
+    return pattern.substr(0, begin) + number + pattern.substr(end);
+}
+
+inline void render_animation(const hittable& world, camera& cam, const camera_path& path, int frame_count,
+                             const std::string& output_pattern) {
+    // render a frame sequence with the scene kept resident; a separate encoder thread tonemaps
+    // and writes frame n while frame n+1 renders
+    using clock = std::chrono::steady_clock;
+
+    int frames = path.count(frame_count);
+    int width = cam.image_width;
+    int height = cam.get_image_height();
+
+    struct encoded_frame {
+        int index;
+        film image;
+    };
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<encoded_frame> queue;    // at most one frame waits while another renders
+    bool done = false;
+    double encode_seconds = 0;
+    std::exception_ptr encode_error;    // first failure writing a frame; later frames are dropped
+
+    std::thread encoder([&]() {
+        std::vector<uint32_t> buffer;
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            changed.wait(lock, [&]() { return !queue.empty() || done; });
+            if (queue.empty())
+                return;
+            encoded_frame f = std::move(queue.front());
+            queue.pop_front();
+            changed.notify_all();
+            lock.unlock();
+
+            auto start = clock::now();
+            std::exception_ptr error;
+            try {
+                if (!encode_error) {
+                    buffer.resize(size_t(width) * height);
+                    f.image.resolve(buffer);
+                    write_to_ppm(width, height, buffer, frame_filename(output_pattern, f.index));
+                }
+            } catch (...) {
+                error = std::current_exception();
+            }
+            double seconds = std::chrono::duration<double>(clock::now() - start).count();
+
+            lock.lock();
+            encode_seconds += seconds;
+            if (error && !encode_error)
+                encode_error = error;
+        }
+    });
+
+    // the encoder must be stopped and joined on every way out of this function, including
+    // a render that throws, or destroying the joinable thread would terminate the process
+    auto finish_encoder = [&]() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            done = true;
+        }
+        changed.notify_all();
+        encoder.join();
+    };
+
+    auto start = clock::now();
+    double render_seconds = 0;
+    try {
+        for (int n = 0; n < frames; n++) {
+            auto key = path.frame(n, frame_count);
+            cam.lookfrom = key.lookfrom;
+            cam.lookat = key.lookat;
+            cam.vfov = key.vfov;
+
+            auto frame_start = clock::now();
+            film image(width, height);
+            cam.render(world, image);
+            render_seconds += std::chrono::duration<double>(clock::now() - frame_start).count();
+
+            // wait only if the encoder has fallen a whole frame behind
+            std::unique_lock<std::mutex> lock(mutex);
+            changed.wait(lock, [&]() { return queue.empty(); });
+            if (encode_error)
+                break;
+            queue.push_back({n, std::move(image)});
+            changed.notify_all();
+        }
+    } catch (...) {
+        finish_encoder();
+        throw;
+    }
+    finish_encoder();
+    if (encode_error)
+        std::rethrow_exception(encode_error);
+
+    double total = std::chrono::duration<double>(clock::now() - start).count();
+    std::clog << "rendered " << frames << " frames in " << total << " s ("
+              << (total > 0 ? frames * 3600.0 / total : 0) << " frames/hour); rendering "
+              << render_seconds << " s, encoding " << encode_seconds << " s, of which "
+              << std::max(0.0, render_seconds + encode_seconds - total) << " s overlapped\n";
+}
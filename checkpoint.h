@@ -0,0 +1,217 @@
+#pragma once
+
+#include "film.h"
+
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Checkpoint file layout (native byte order):
+//   checkpoint_header, padded to a page
+//   slot 0: float accum[3 * width * height], uint32_t samples[width * height], padded to a page
+//   slot 1: same as slot 0
+// Snapshots alternate between the two slots and the header names the newest complete one, so
+// a crash in the middle of a write always leaves the previous snapshot intact.
+struct checkpoint_header {
+    char magic[8];              // "RTCKPT1\0"
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t active_slot;       // slot with the newest complete snapshot, or no_slot
+    uint64_t seed;              // camera seed; with the sample counts this is the whole sampler state
+    uint32_t passes[2];         // passes completed in each slot
+    uint32_t max_depth;
+    uint32_t reserved;
+    uint64_t view_hash;         // camera::fingerprint, i.e. view settings and scene content
+};
+
+class render_checkpoint {
+    // memory-mapped checkpoint of a progressive render, written by a background thread so the
+    // render threads only pay for copying the film into a staging buffer
+
+    public:
+        render_checkpoint(const std::string& path, int width, int height, uint64_t seed, int max_depth,
+                          uint64_t view_hash, bool resume)
+         : width(width), height(height), staging(width, height)
+        {
+            size_t page = size_t(::sysconf(_SC_PAGESIZE));
+            size_t pixels = size_t(width) * height;
+            slot_bytes = pixels * (3 * sizeof(float) + sizeof(uint32_t));
+            slot_offset[0] = round_up(sizeof(checkpoint_header), page);
+            slot_offset[1] = slot_offset[0] + round_up(slot_bytes, page);
+            map_bytes = slot_offset[1] + round_up(slot_bytes, page);
+
+            int fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+            if (fd < 0)
+                throw std::runtime_error("cannot open checkpoint " + path);
+
+            struct stat st;
+            bool existing = ::fstat(fd, &st) == 0 && size_t(st.st_size) == map_bytes;
+            if (resume && !existing) {
+                ::close(fd);
+                throw std::runtime_error(path + ": no checkpoint for this image size to resume from");
+            }
+            if (!existing && ::ftruncate(fd, off_t(map_bytes)) != 0) {
+                ::close(fd);
+                throw std::runtime_error("cannot size checkpoint " + path);
+            }
+
+            void* p = ::mmap(nullptr, map_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            ::close(fd);
+            if (p == MAP_FAILED)
+                throw std::runtime_error("cannot map checkpoint " + path);
+            base = static_cast<char*>(p);
+
+            if (resume) {
+                const auto& h = header();
+                if (std::memcmp(h.magic, magic, sizeof(h.magic)) != 0 || h.version != version
+                    || h.width != uint32_t(width) || h.height != uint32_t(height))
+                    throw_and_unmap(path + ": not a checkpoint of this render");
+                if (h.active_slot != 0 && h.active_slot != 1 && h.active_slot != no_slot)
+                    throw_and_unmap(path + ": corrupt checkpoint header");
+                if (h.seed != seed)
+                    throw_and_unmap(path + ": checkpoint was rendered with a different seed");
+                if (h.max_depth != uint32_t(max_depth))
+                    throw_and_unmap(path + ": checkpoint was rendered with a different depth");
+                if (h.view_hash != view_hash)
+                    throw_and_unmap(path + ": checkpoint was rendered from a different camera or scene");
+            } else {
+                checkpoint_header h = {};
+                std::memcpy(h.magic, magic, sizeof(h.magic));
+                h.version = version;
+                h.width = uint32_t(width);
+                h.height = uint32_t(height);
+                h.active_slot = no_slot;
+                h.seed = seed;
+                h.max_depth = uint32_t(max_depth);
+                h.view_hash = view_hash;
+                header() = h;
+                ::msync(base, slot_offset[0], MS_SYNC);
+            }
+
+            writer = std::thread([this]() { write_loop(); });
+        }
+
+        ~render_checkpoint() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            wake.notify_all();
+            writer.join();
+            ::munmap(base, map_bytes);
+        }
+
+        render_checkpoint(const render_checkpoint&) = delete;
+        render_checkpoint& operator=(const render_checkpoint&) = delete;
+
+        int restore(film& image) const {
+            // load the newest snapshot into `image`; returns the number of passes it holds
+            const auto& h = header();
+            if (h.active_slot == no_slot)
+                return 0;
+
+            size_t pixels = size_t(width) * height;
+            const char* slot = base + slot_offset[h.active_slot];
+            std::memcpy(image.accum.data(), slot, 3 * pixels * sizeof(float));
+            std::memcpy(image.samples.data(), slot + 3 * pixels * sizeof(float), pixels * sizeof(uint32_t));
+            return int(h.passes[h.active_slot]);
+        }
+
+        bool save_async(const film& image, int pass) {
+            // hand a snapshot to the writer thread; if it is still busy with the previous one
+            // this snapshot is skipped rather than making the caller wait
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (pending)
+                    return false;
+                staging.accum = image.accum;
+                staging.samples = image.samples;
+                staging_pass = pass;
+                pending = true;
+            }
+            wake.notify_all();
+            return true;
+        }
+
+        void save(const film& image, int pass) {
+            // blocking save, e.g. for the final pass
+            flush();
+            save_async(image, pass);
+            flush();
+        }
+
+        void flush() {
+            std::unique_lock<std::mutex> lock(mutex);
+            idle.wait(lock, [this]() { return !pending; });
+        }
+
+    private:
+        static constexpr char magic[8] = {'R', 'T', 'C', 'K', 'P', 'T', '1', '\0'};
+        static constexpr uint32_t version = 2;
+        static constexpr uint32_t no_slot = ~0u;
+
+        int width, height;
+        char* base = nullptr;
+        size_t map_bytes = 0;
+        size_t slot_bytes = 0;
+        size_t slot_offset[2];
+
+        std::mutex mutex;
+        std::condition_variable wake, idle;
+        film staging;
+        int staging_pass = 0;
+        bool pending = false;
+        bool stopping = false;
+        std::thread writer;
+
+        static size_t round_up(size_t n, size_t multiple) {
+            return (n + multiple - 1) / multiple * multiple;
+        }
+
+        checkpoint_header& header() const {
+            return *reinterpret_cast<checkpoint_header*>(base);
+        }
+
+        [[noreturn]] void throw_and_unmap(const std::string& message) {
+            ::munmap(base, map_bytes);
+            throw std::runtime_error(message);
+        }
+
+        void write_loop() {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (true) {
+                wake.wait(lock, [this]() { return pending || stopping; });
+                if (!pending)
+                    return;
+
+                // `staging` is left alone by save_async while `pending` is set, so the copy
+                // into the mapping can run unlocked
+                lock.unlock();
+                auto& h = header();
+                uint32_t slot = (h.active_slot == 0) ? 1 : 0;
+                size_t pixels = size_t(width) * height;
+                char* dst = base + slot_offset[slot];
+                std::memcpy(dst, staging.accum.data(), 3 * pixels * sizeof(float));
+                std::memcpy(dst + 3 * pixels * sizeof(float), staging.samples.data(), pixels * sizeof(uint32_t));
+                ::msync(dst, slot_bytes, MS_SYNC);
+
+                // publish the slot only once its contents are on disk
+                h.passes[slot] = uint32_t(staging_pass);
+                h.active_slot = slot;
+                ::msync(base, slot_offset[0], MS_SYNC);
+                lock.lock();
+
+                pending = false;
+                idle.notify_all();
+            }
+        }
+};
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cmath>
+#include <cstdint>
 #include <cstdlib>
 #include <iostream>
 #include <limits>
@@ -19,9 +20,28 @@ inline double degrees_to_radians(double degrees) {
     return degrees * pi / 180.0;
 }
 
+inline uint64_t mix_bits(uint64_t z) {
+    // splitmix64 finalizer: scrambles an integer into a well-distributed 64-bit value
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+inline uint64_t& random_state() {
+    // per-thread generator state, so render threads never share (or race on) a sequence
+    thread_local uint64_t state = 0x853c49e6748fea9bULL;
+    return state;
+}
+
+inline void seed_random(uint64_t seed) {
+    random_state() = mix_bits(seed);
+}
+
 inline double random_double() {
     // returns a random real in [0,1)
-    return std::rand() / (RAND_MAX + 1.0);
+    uint64_t& state = random_state();
+    state += 0x9e3779b97f4a7c15ULL;
+    return (mix_bits(state) >> 11) * 0x1.0p-53;
 }
 
 inline double random_double(double min, double max) {
@@ -0,0 +1,305 @@
+// Convergence benchmark and image regression harness.
+//
+// Renders the reference scenes from scenes.h, measures error against a high-spp ground truth
+// as a function of wall-clock render time, and writes the curves as JSON. With --baseline the
+// final error of every scene is compared against an earlier run and the process exits with
+// status 1 when it got worse by more than --tolerance.
+
+#include "render.h"
+#include "scenes.h"
+#include "image_metrics.h"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+struct convergence_options {
+    std::vector<std::string> scenes = reference_scene_names();
+    int image_width = 160;
+    int samples_per_pixel = 64;
+    int max_depth = 8;
+    int truth_spp = 1024;
+    std::string truth_dir = ".";
+    uint64_t seed = 0;
+    int threads = 0;
+    std::string label;                  // free-form tag for the run, e.g. a commit hash
+    std::string json = "convergence.json";
+    std::string baseline;
+    double tolerance = 0.05;            // allowed relative increase of the final relMSE
+
+    irradiance_cache_settings irradiance;   // renderer configuration under test
+};
+
+struct curve_point {
+    int spp;
+    double seconds;
+    double rmse;
+    double rel_mse;
+};
+
+struct scene_result {
+    std::string name;
+    int width, height;
+    std::vector<curve_point> curve;
+};
+
+static const char* convergence_usage =
+    "usage: convergence [--scenes a,b,...] [--width n] [--spp n] [--depth n] [--truth-spp n]\n"
+    "                   [--truth-dir dir] [--seed n] [--threads n] [--label text] [--json file]\n"
+    "                   [--baseline file] [--tolerance x]\n"
+    "                   [--irradiance-cache [--ic-cell-size d] [--ic-max-error x] [--ic-min-samples n]\n"
+    "                                       [--ic-budget-mb n]]\n";
+
+static convergence_options parse_convergence_options(int argc, char** argv) {
+    convergence_options opts;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc)
+                throw std::runtime_error("missing value for " + arg);
+            return argv[++i];
+        };
+
+        if (arg == "--scenes") {
+            opts.scenes.clear();
+            std::stringstream list(value());
+            for (std::string name; std::getline(list, name, ',');)
+                opts.scenes.push_back(name);
+        }
+        else if (arg == "--width")      opts.image_width = std::stoi(value());
+        else if (arg == "--spp")        opts.samples_per_pixel = std::stoi(value());
+        else if (arg == "--depth")      opts.max_depth = std::stoi(value());
+        else if (arg == "--truth-spp")  opts.truth_spp = std::stoi(value());
+        else if (arg == "--truth-dir")  opts.truth_dir = value();
+        else if (arg == "--seed")       opts.seed = std::stoull(value());
+        else if (arg == "--threads")    opts.threads = std::stoi(value());
+        else if (arg == "--label")      opts.label = value();
+        else if (arg == "--json")       opts.json = value();
+        else if (arg == "--baseline")   opts.baseline = value();
+        else if (arg == "--tolerance")  opts.tolerance = std::stod(value());
+        else if (opts.irradiance.parse_flag(arg, value)) {}
+        else
+            throw std::runtime_error("unknown option " + arg);
+    }
+    opts.irradiance.validate();
+    return opts;
+}
+
+static std::vector<float> ground_truth(const std::string& name, const hittable& world, camera cam,
+                                       const convergence_options& opts) {
+    // rendered once per scene/size/depth/spp and cached as a PFM next to the results; the
+    // camera fingerprint in the name retires the cached truth whenever the scene or its camera
+    // changes. The seed differs from the measured runs so the truth's own noise is independent
+    // of theirs
+    char fingerprint[17];
+    std::snprintf(fingerprint, sizeof(fingerprint), "%016llx", (unsigned long long)cam.fingerprint(world));
+    std::string path = opts.truth_dir + "/truth_" + name + "_" + std::to_string(cam.image_width)
+                     + "_d" + std::to_string(cam.max_depth) + "_s" + std::to_string(opts.truth_spp)
+                     + "_" + fingerprint + ".pfm";
+
+    std::vector<float> truth;
+    if (read_pfm(path, cam.image_width, cam.get_image_height(), truth))
+        return truth;
+
+    std::clog << "rendering ground truth for " << name << " at " << opts.truth_spp << " spp\n";
+    cam.samples_per_pixel = opts.truth_spp;
+    cam.seed = ~opts.seed;
+    film image(cam.image_width, cam.get_image_height());
+    cam.render(world, image);
+    truth = film_average(image);
+    write_pfm(path, cam.image_width, cam.get_image_height(), truth);
+    return truth;
+}
+
+static scene_result measure(const std::string& name, const convergence_options& opts) {
+    using clock = std::chrono::steady_clock;
+
+    hittable_list world;
+    camera cam(16.0 / 9.0, opts.image_width);
+    if (!build_reference_scene(name, world, cam))
+        throw std::runtime_error("unknown scene " + name);
+    cam.max_depth = opts.max_depth;
+    cam.thread_count = opts.threads;
+
+    auto truth = ground_truth(name, world, cam, opts);
+
+    scene_result result{name, cam.image_width, cam.get_image_height(), {}};
+    cam.samples_per_pixel = opts.samples_per_pixel;
+    cam.seed = opts.seed;
+    // a fresh cache per scene, after the ground truth, which never uses one
+    cam.irradiance = make_irradiance_cache(opts.irradiance);
+
+    // sample the curve at powers of two and at the final pass; time spent computing the
+    // metrics is taken out of the render time
+    film image(cam.image_width, cam.get_image_height());
+    double excluded = 0;
+    auto start = clock::now();
+    cam.render(world, image, [&](const film& f, int pass) {
+        if ((pass & (pass - 1)) != 0 && pass != opts.samples_per_pixel)
+            return;
+        auto metrics_start = clock::now();
+        double seconds = std::chrono::duration<double>(metrics_start - start).count() - excluded;
+        auto current = film_average(f);
+        result.curve.push_back({pass, seconds, rmse(current, truth), relative_mse(current, truth)});
+        excluded += std::chrono::duration<double>(clock::now() - metrics_start).count();
+    });
+
+    const auto& last = result.curve.back();
+    std::clog << name << ": " << last.spp << " spp in " << last.seconds << " s, rmse " << last.rmse
+              << ", relMSE " << last.rel_mse << '\n';
+    return result;
+}
+
+static std::string json_escape(const std::string& text) {
+    std::string out;
+    for (unsigned char c : text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += char(c);
+        } else if (c < 0x20) {
+            char code[8];
+            std::snprintf(code, sizeof(code), "\\u%04x", c);
+            out += code;
+        } else {
+            out += char(c);
+        }
+    }
+    return out;
+}
+
+static std::vector<std::pair<std::string, std::string>> run_settings(const convergence_options& opts) {
+    // settings that change what the measured error means; a baseline is only comparable when
+    // all of them match. Values are kept as the text written to the JSON
+    std::vector<std::pair<std::string, std::string>> settings;
+    auto add = [&](const std::string& key, auto value) {
+        std::ostringstream text;
+        text << std::setprecision(9) << std::boolalpha << value;
+        settings.emplace_back(key, text.str());
+    };
+    add("max_depth", opts.max_depth);
+    add("truth_spp", opts.truth_spp);
+    add("irradiance_cache", opts.irradiance.enabled);
+    add("ic_cell_size", opts.irradiance.cell_size);
+    add("ic_max_error", opts.irradiance.max_relative_error);
+    add("ic_min_samples", opts.irradiance.min_samples);
+    add("ic_budget_mb", opts.irradiance.budget_mb);
+    return settings;
+}
+
+static void write_json(const std::string& path, const convergence_options& opts,
+                       const std::vector<scene_result>& results) {
+    std::ofstream out(path);
+    out << std::setprecision(9);
+    out << "{\n  \"label\": \"" << json_escape(opts.label) << "\",\n"
+        << "  \"seed\": " << opts.seed << ",\n";
+    for (const auto& [key, value] : run_settings(opts))
+        out << "  \"" << key << "\": " << value << ",\n";
+    out << "  \"scenes\": [\n";
+    for (size_t s = 0; s < results.size(); s++) {
+        const auto& r = results[s];
+        out << "    {\n      \"name\": \"" << r.name << "\",\n"
+            << "      \"width\": " << r.width << ",\n      \"height\": " << r.height << ",\n"
+            << "      \"final_spp\": " << r.curve.back().spp << ",\n"
+            << "      \"final_rel_mse\": " << r.curve.back().rel_mse << ",\n"
+            << "      \"curve\": [\n";
+        for (size_t i = 0; i < r.curve.size(); i++) {
+            const auto& p = r.curve[i];
+            out << "        {\"spp\": " << p.spp << ", \"seconds\": " << p.seconds << ", \"rmse\": "
+                << p.rmse << ", \"rel_mse\": " << p.rel_mse << "}" << (i + 1 < r.curve.size() ? "," : "") << '\n';
+        }
+        out << "      ]\n    }" << (s + 1 < results.size() ? "," : "") << '\n';
+    }
+    out << "  ]\n}\n";
+}
+
+static bool baseline_value(const std::string& json, const std::string& scene, const std::string& key, double& value) {
+    // pulls `key` out of the named scene's object in a file written by write_json
+    auto at = json.find("\"name\": \"" + scene + "\"", json.find("\"scenes\""));
+    if (at == std::string::npos)
+        return false;
+    auto end = json.find("\"curve\"", at);
+    auto field = json.find("\"" + key + "\": ", at);
+    if (field == std::string::npos || field > end)
+        return false;
+    value = std::stod(json.substr(field + key.size() + 4));
+    return true;
+}
+
+static bool baseline_setting(const std::string& json, const std::string& key, std::string& value) {
+    // pulls the raw text of a top-level setting, which write_json puts before the scenes
+    auto field = json.find("\"" + key + "\": ");
+    if (field == std::string::npos || field > json.find("\"scenes\""))
+        return false;
+    auto start = field + key.size() + 4;
+    value = json.substr(start, json.find_first_of(",\n", start) - start);
+    return true;
+}
+
+static int check_baseline(const convergence_options& opts, const std::vector<scene_result>& results) {
+    std::ifstream in(opts.baseline);
+    if (!in)
+        throw std::runtime_error("cannot open baseline " + opts.baseline);
+    std::string json((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+    for (const auto& [key, value] : run_settings(opts)) {
+        std::string base;
+        if (!baseline_setting(json, key, base))
+            throw std::runtime_error("baseline " + opts.baseline + " does not record " + key);
+        if (base != value)
+            throw std::runtime_error("baseline " + opts.baseline + " was made with " + key + " " + base
+                                     + ", this run uses " + value);
+    }
+
+    int regressions = 0;
+    for (const auto& r : results) {
+        double base_error, base_spp, base_width, base_height;
+        if (!baseline_value(json, r.name, "final_rel_mse", base_error)
+            || !baseline_value(json, r.name, "final_spp", base_spp)
+            || !baseline_value(json, r.name, "width", base_width)
+            || !baseline_value(json, r.name, "height", base_height)) {
+            std::clog << r.name << ": not in baseline, skipped\n";
+            continue;
+        }
+        if (int(base_spp) != r.curve.back().spp) {
+            std::clog << r.name << ": baseline has " << base_spp << " spp, skipped\n";
+            continue;
+        }
+        if (int(base_width) != r.width || int(base_height) != r.height) {
+            std::clog << r.name << ": baseline is " << base_width << 'x' << base_height << ", skipped\n";
+            continue;
+        }
+
+        double current = r.curve.back().rel_mse;
+        bool regressed = current > base_error * (1 + opts.tolerance);
+        std::clog << r.name << ": relMSE " << current << " vs baseline " << base_error
+                  << (regressed ? "  REGRESSION" : "  ok") << '\n';
+        regressions += regressed;
+    }
+    return regressions > 0 ? 1 : 0;
+}
+
+int main(int argc, char** argv) {
+    convergence_options opts;
+    try {
+        opts = parse_convergence_options(argc, argv);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << '\n' << convergence_usage;
+        return 2;
+    }
+
+    try {
+        std::vector<scene_result> results;
+        for (const auto& name : opts.scenes)
+            results.push_back(measure(name, opts));
+
+        write_json(opts.json, opts, results);
+        if (!opts.baseline.empty())
+            return check_baseline(opts, results);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << '\n';
+        return 2;
+    }
+    return 0;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "constants.h"
+
+#include <algorithm>
+#include <vector>
+
+class film {
+    // floating-point accumulation buffer for progressive rendering: running rgb sums and the
+    // number of samples that went into each pixel
+
+    public:
+        int width = 0;
+        int height = 0;
+        int x0 = 0, y0 = 0;             // image position of the film's first pixel, for a tile
+        std::vector<float> accum;       // rgb sums, 3 floats per pixel
+        std::vector<uint32_t> samples;  // samples taken per pixel
+
+        film() {}
+
+        film(int width, int height, int x0 = 0, int y0 = 0)
+         : width(width), height(height), x0(x0), y0(y0), accum(3 * size_t(width) * height, 0.0f),
+           samples(size_t(width) * height, 0) {}
+
+        size_t pixel_count() const { return samples.size(); }
+
+        void clear() {
+            std::fill(accum.begin(), accum.end(), 0.0f);
+            std::fill(samples.begin(), samples.end(), 0);
+        }
+
+        void add_sample(size_t index, const color& c) {
+            accum[3 * index]     += float(c.x());
+            accum[3 * index + 1] += float(c.y());
+            accum[3 * index + 2] += float(c.z());
+            samples[index]++;
+        }
+
+        color average(size_t index) const {
+            if (samples[index] == 0)
+                return color(0, 0, 0);
+            double scale = 1.0 / samples[index];
+            return scale * color(accum[3 * index], accum[3 * index + 1], accum[3 * index + 2]);
+        }
+
+        uint32_t min_samples() const {
+            uint32_t lowest = samples.empty() ? 0 : samples[0];
+            for (auto s : samples)
+                lowest = s < lowest ? s : lowest;
+            return lowest;
+        }
+
+        void resolve(std::vector<uint32_t>& buffer) const {
+            // tonemap the running averages into the packed 8-bit display buffer
+            for (size_t i = 0; i < pixel_count(); i++)
+                write_color(buffer, i, average(i));
+        }
+};
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "constants.h"
+#include "aabb.h"
 
 class material;
 
@@ -22,7 +23,7 @@ class hit_record {
 
         void set_normal_angle(const ray& r, const vec3& outward_normal) {
             // this is the unit direction vector of the ray (|ray_direction| = 1)
-            vec3 ray_direction = unit_vector(r.direction());
+            vec3 ray_direction = r.unit_direction();
             double angle = acos(dot(ray_direction, outward_normal));
             normal_angle = angle;
         }
@@ -33,4 +34,13 @@ class hittable {
         virtual ~hittable() = default;
 
         virtual bool hit(const ray&r, interval ray_t, hit_record& rec) const = 0;
+
+        virtual bool hit_any(const ray& r, interval ray_t) const {
+            // occlusion query (e.g. shadow rays): true if anything is hit in ray_t; unlike hit()
+            // it may stop at the first intersection found and fills in no hit record
+            hit_record rec;
+            return hit(r, ray_t, rec);
+        }
+
+        virtual aabb bounding_box() const = 0;
 };
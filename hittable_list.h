@@ -12,10 +12,14 @@ class hittable_list : public hittable {
         hittable_list() {}
         hittable_list(shared_ptr<hittable> object) { add(object); }
 
-        void clear() { objects.clear(); }
+        void clear() {
+            objects.clear();
+            bbox = aabb();
+        }
 
         void add(shared_ptr<hittable> object) {
             objects.push_back(object);
+            bbox = aabb(bbox, object->bounding_box());
         }
 
         bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
@@ -32,4 +36,17 @@ class hittable_list : public hittable {
             }
             return hit_anything;
         }
+
+        bool hit_any(const ray& r, interval ray_t) const override {
+            for (const auto& object: objects) {
+                if (object->hit_any(r, ray_t))
+                    return true;
+            }
+            return false;
+        }
+
+        aabb bounding_box() const override { return bbox; }
+
+    private:
+        aabb bbox;
 };
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "film.h"
+
+#include <cmath>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Error metrics between a progressive render and a reference image, both given as linear
+// (pre-gamma) rgb floats, 3 per pixel.
+
+inline std::vector<float> film_average(const film& image) {
+    std::vector<float> rgb(3 * image.pixel_count());
+    for (size_t i = 0; i < image.pixel_count(); i++) {
+        auto c = image.average(i);
+        rgb[3 * i] = float(c.x());
+        rgb[3 * i + 1] = float(c.y());
+        rgb[3 * i + 2] = float(c.z());
+    }
+    return rgb;
+}
+
+inline double rmse(const std::vector<float>& image, const std::vector<float>& reference) {
+    double sum = 0;
+    for (size_t i = 0; i < image.size(); i++) {
+        double d = double(image[i]) - reference[i];
+        sum += d * d;
+    }
+    return std::sqrt(sum / image.size());
+}
+
+inline double relative_mse(const std::vector<float>& image, const std::vector<float>& reference) {
+    // squared error relative to the reference value, so dark and bright regions weigh alike;
+    // the epsilon keeps black reference pixels from dominating
+    double sum = 0;
+    for (size_t i = 0; i < image.size(); i++) {
+        double d = double(image[i]) - reference[i];
+        sum += d * d / (double(reference[i]) * reference[i] + 1e-2);
+    }
+    return sum / image.size();
+}
+
+inline void write_pfm(const std::string& path, int width, int height, const std::vector<float>& rgb) {
+    // portable float map, little-endian (negative scale), rows stored bottom to top
+    std::ofstream out(path, std::ios::binary);
+    out << "PF\n" << width << ' ' << height << "\n-1.0\n";
+    for (int j = height - 1; j >= 0; j--)
+        out.write(reinterpret_cast<const char*>(rgb.data() + 3 * size_t(j) * width), 3 * sizeof(float) * width);
+    if (!out)
+        throw std::runtime_error("failed writing " + path);
+}
+
+inline bool read_pfm(const std::string& path, int width, int height, std::vector<float>& rgb) {
+    // returns false when the file is missing or does not match the expected size
+    std::ifstream in(path, std::ios::binary);
+    std::string magic;
+    int w = 0, h = 0;
+    double scale = 0;
+    if (!(in >> magic >> w >> h >> scale) || magic != "PF" || w != width || h != height || scale >= 0)
+        return false;
+    in.get(); // single whitespace before the raster
+
+    rgb.resize(3 * size_t(width) * height);
+    for (int j = height - 1; j >= 0; j--)
+        in.read(reinterpret_cast<char*>(rgb.data() + 3 * size_t(j) * width), 3 * sizeof(float) * width);
+    return bool(in);
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "constants.h"
+#include "hittable.h"
+#include "transform.h"
+
+class instance : public hittable {
+    // places a shared sub-scene in the world through an affine transform; the referenced
+    // object (a sphere, a hittable_list, or another instance) is never copied, so a cluster
+    // repeated n times costs n small instances instead of n copies of its contents (the
+    // "instanced" reference scene reports the per-instance size)
+
+    public:
+        instance(shared_ptr<hittable> object, const affine_transform& object_to_world)
+         : object(object), world_to_object(object_to_world.inverse())
+        {
+            bbox = object_to_world.apply_box(object->bounding_box());
+        }
+
+        bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+            // cull against the world-space bounds before paying for the ray transform
+            if (!bbox.hit(r, ray_t))
+                return false;
+
+            // move the ray into object space; the direction is not renormalized, so the
+            // ray parameter `t` is the same in both spaces
+            ray object_r(world_to_object.apply_point(r.origin()),
+                         world_to_object.apply_vector(r.direction()));
+
+            if (!object->hit(object_r, ray_t, rec))
+                return false;
+
+            // move the intersection back to world space; normals transform with the
+            // inverse transpose, which keeps them facing against the ray
+            rec.p = r.at(rec.t);
+            rec.normal = unit_vector(world_to_object.apply_transposed(rec.normal));
+            rec.set_normal_angle(r, rec.front_face ? rec.normal : -rec.normal);
+
+            return true;
+        }
+
+        bool hit_any(const ray& r, interval ray_t) const override {
+            if (!bbox.hit(r, ray_t))
+                return false;
+            ray object_r(world_to_object.apply_point(r.origin()),
+                         world_to_object.apply_vector(r.direction()));
+            return object->hit_any(object_r, ray_t);
+        }
+
+        aabb bounding_box() const override { return bbox; }
+
+    private:
+        shared_ptr<hittable> object;
+        affine_transform world_to_object;
+        aabb bbox;
+};
@@ -8,6 +8,12 @@ class interval {
 
         interval(double min, double max) : min(min), max(max) {}
 
+        interval(const interval& a, const interval& b) {
+            // create the interval tightly enclosing the two input intervals
+            min = a.min <= b.min ? a.min : b.min;
+            max = a.max >= b.max ? a.max : b.max;
+        }
+
         double size() const {
             return max - min;
         }
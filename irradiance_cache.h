@@ -0,0 +1,215 @@
+#pragma once
+
+#include "constants.h"
+
+#include <algorithm>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+class irradiance_cache {
+    // spatial hash grid of incoming radiance at diffuse surfaces, keyed by a quantized
+    // position and normal. Diffuse hits record the radiance their bounce gathered; once a cell
+    // has enough samples and a small enough error, later secondary diffuse hits in that cell
+    // return its mean instead of tracing the rest of the path.
+    //
+    // Reusing estimates across pixels trades a little bias (blurring within a cell) for far
+    // fewer deep bounces, and makes results depend on the order threads fill the cache.
+
+    public:
+        double cell_size = 0.1;         // grid spacing in world units
+        int min_samples = 8;            // samples a cell needs before it is used
+        double max_relative_error = 0.2;// allowed standard error of a cell's mean, relative to it
+
+        explicit irradiance_cache(size_t memory_budget_bytes = size_t(64) << 20) {
+            // a fixed table sized from the budget: when it fills up new cells are simply not
+            // created, so memory use never grows past the budget
+            size_t per_shard = std::max<size_t>(16, memory_budget_bytes / sizeof(cell) / shard_count);
+            size_t capacity = 1;
+            while (capacity * 2 <= per_shard)
+                capacity *= 2;
+            for (auto& s : shards)
+                s.cells.resize(capacity);
+        }
+
+        size_t memory_bytes() const {
+            return shard_count * shards[0].cells.size() * sizeof(cell);
+        }
+
+        bool lookup(const point3& p, const vec3& normal, color& radiance) {
+            cell_coord coord = quantize(p, normal);
+            uint64_t key = cell_key(coord);
+            auto& s = shards[key % shard_count];
+            std::lock_guard<std::mutex> lock(s.mutex);
+
+            s.lookups++;
+            const cell* c = find(s, key, coord, false);
+            if (!c || !converged(*c))
+                return false;
+
+            double n = c->count;
+            radiance = color(c->rgb[0] / n, c->rgb[1] / n, c->rgb[2] / n);
+            s.hits++;
+            return true;
+        }
+
+        void record(const point3& p, const vec3& normal, const color& radiance) {
+            // converged cells are frozen: more samples would only cost lock time
+            cell_coord coord = quantize(p, normal);
+            uint64_t key = cell_key(coord);
+            auto& s = shards[key % shard_count];
+            std::lock_guard<std::mutex> lock(s.mutex);
+
+            cell* c = find(s, key, coord, true);
+            if (!c) {
+                s.dropped++;
+                return;
+            }
+            if (converged(*c))
+                return;
+            double lum = (radiance.x() + radiance.y() + radiance.z()) / 3;
+            c->rgb[0] += radiance.x();
+            c->rgb[1] += radiance.y();
+            c->rgb[2] += radiance.z();
+            c->luminance_sum += lum;
+            c->luminance_sq_sum += lum * lum;
+            c->count++;
+        }
+
+        void report(std::ostream& out) {
+            size_t used = 0;
+            long long lookups = 0, hits = 0, dropped = 0;
+            for (auto& s : shards) {
+                std::lock_guard<std::mutex> lock(s.mutex);
+                for (const auto& c : s.cells)
+                    used += c.key != empty_key;
+                lookups += s.lookups;
+                hits += s.hits;
+                dropped += s.dropped;
+            }
+            out << "irradiance cache: " << used << " cells (" << memory_bytes() / (1 << 20) << " MiB budget), "
+                << hits << " hits / " << lookups << " lookups, " << dropped << " records dropped\n";
+        }
+
+    private:
+        struct cell_coord {
+            // full grid coordinates, stored with each cell so that distant cells whose keys
+            // collide are told apart rather than sharing radiance
+            int32_t x = 0, y = 0, z = 0;
+            uint32_t normal_bin = 0;
+
+            bool operator==(const cell_coord& o) const {
+                return x == o.x && y == o.y && z == o.z && normal_bin == o.normal_bin;
+            }
+        };
+
+        struct cell {
+            uint64_t key = empty_key;
+            cell_coord coord;
+            double rgb[3] = {0, 0, 0};
+            double luminance_sum = 0;
+            double luminance_sq_sum = 0;
+            uint32_t count = 0;
+        };
+
+        struct alignas(64) shard {
+            // counters live with the lock that already guards them, one cache line per shard
+            std::mutex mutex;
+            std::vector<cell> cells;    // open addressing, linear probing
+            long long lookups = 0, hits = 0, dropped = 0;
+        };
+
+        static constexpr uint64_t empty_key = ~0ULL;
+        static constexpr size_t shard_count = 64;   // independent locks, so render threads rarely wait
+        static constexpr int max_probes = 16;
+
+        shard shards[shard_count];
+
+        bool converged(const cell& c) const {
+            // enough samples, and the standard error of the mean luminance small relative to it
+            if (c.count < uint32_t(min_samples))
+                return false;
+            double n = c.count;
+            double mean_lum = c.luminance_sum / n;
+            double variance = std::fmax(0.0, c.luminance_sq_sum / n - mean_lum * mean_lum);
+            return mean_lum > 0 && std::sqrt(variance / n) <= max_relative_error * mean_lum;
+        }
+
+        cell_coord quantize(const point3& p, const vec3& normal) const {
+            // grid cell of the position, plus the normal quantized to 4 levels per axis
+            auto grid = [&](double x) {
+                return int32_t(std::fmax(-2147483648.0, std::fmin(2147483647.0, std::floor(x / cell_size))));
+            };
+            auto bin = [](double x) { return uint32_t(std::fmin(3.0, std::floor((x + 1) * 2))); };
+            cell_coord c;
+            c.x = grid(p.x());
+            c.y = grid(p.y());
+            c.z = grid(p.z());
+            c.normal_bin = bin(normal.x()) | (bin(normal.y()) << 2) | (bin(normal.z()) << 4);
+            return c;
+        }
+
+        static uint64_t cell_key(const cell_coord& c) {
+            // mixed so neighbouring cells spread over shards and slots
+            uint64_t key = mix_bits((uint64_t(uint32_t(c.x)) << 32) | uint32_t(c.y));
+            key = mix_bits(key ^ ((uint64_t(uint32_t(c.z)) << 32) | c.normal_bin));
+            return key & ~(1ULL << 63); // never equal to empty_key
+        }
+
+        cell* find(shard& s, uint64_t key, const cell_coord& coord, bool create) {
+            size_t mask = s.cells.size() - 1;
+            size_t slot = size_t(key >> 6) & mask;   // low bits already chose the shard
+            for (int probe = 0; probe < max_probes; probe++, slot = (slot + 1) & mask) {
+                cell& c = s.cells[slot];
+                if (c.key == key && c.coord == coord)
+                    return &c;
+                if (c.key == empty_key) {
+                    if (!create)
+                        return nullptr;
+                    c.key = key;
+                    c.coord = coord;
+                    return &c;
+                }
+            }
+            return nullptr;
+        }
+};
+
+struct irradiance_cache_settings {
+    // command line configuration of the cache, shared by the renderer and the convergence harness
+    bool enabled = false;
+    double cell_size = 0.1;
+    double max_relative_error = 0.2;
+    int min_samples = 8;
+    int budget_mb = 64;
+
+    // applies --irradiance-cache or one of the --ic-* flags; false if arg is none of them
+    template <typename Value>
+    bool parse_flag(const std::string& arg, Value value) {
+        if (arg == "--irradiance-cache")        enabled = true;
+        else if (arg == "--ic-cell-size")       cell_size = std::stod(value());
+        else if (arg == "--ic-max-error")       max_relative_error = std::stod(value());
+        else if (arg == "--ic-min-samples")     min_samples = std::stoi(value());
+        else if (arg == "--ic-budget-mb")       budget_mb = std::stoi(value());
+        else
+            return false;
+        return true;
+    }
+
+    void validate() const {
+        if (cell_size <= 0 || budget_mb < 1)
+            throw std::runtime_error("--ic-cell-size and --ic-budget-mb must be positive");
+    }
+};
+
+inline shared_ptr<irradiance_cache> make_irradiance_cache(const irradiance_cache_settings& settings) {
+    // an empty pointer when the cache is disabled, so the result can go straight into camera
+    if (!settings.enabled)
+        return nullptr;
+    auto cache = make_shared<irradiance_cache>(size_t(settings.budget_mb) << 20);
+    cache->cell_size = settings.cell_size;
+    cache->max_relative_error = settings.max_relative_error;
+    cache->min_samples = settings.min_samples;
+    return cache;
+}
@@ -5,31 +5,56 @@
 #define GL_SILENCE_DEPRECATION // To silence deprecation warnings
 #include <GLFW/glfw3.h>
 #include "render.h"
+#include "scenes.h"
+#include "options.h"
+#include "offline.h"
+#include "render_server.h"
 
-int main(int, char**)
+int main(int argc, char** argv)
 {
-    hittable_list world;
-
+    render_options opts;
+    try {
+        opts = parse_options(argc, argv);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << '\n' << render_usage;
+        return 2;
+    }
 
-    auto material_ground = make_shared<lambertian>(color(0.8, 0.8, 0.0));
-    auto material_center = make_shared<lambertian>(color(0.1, 0.2, 0.5));
-    auto material_left   = make_shared<dielectric>(1.50);
-    auto material_bubble = make_shared<dielectric>(1.00 / 1.50);
-    auto material_right  = make_shared<metal>(color(0.8, 0.6, 0.2), 1.0);
+    if (!opts.server_socket.empty()) {
+        try {
+            render_server server(opts.server_socket, opts.server_jobs, opts.threads, size_t(opts.scene_cache));
+            return server.run();
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << '\n';
+            return 1;
+        }
+    }
 
-    world.add(make_shared<sphere>(point3( 0.0, -100.5, -1.0), 100.0, material_ground));
-    world.add(make_shared<sphere>(point3( 0.0,    0.0, -1.2),   0.5, material_center));
-    world.add(make_shared<sphere>(point3(-1.0,    0.0, -1.0),   0.5, material_left));
-    world.add(make_shared<sphere>(point3(-1.0,    0.0, -1.0),   0.4, material_bubble));
-    world.add(make_shared<sphere>(point3( 1.0,    0.0, -1.0),   0.5, material_right));
+    hittable_list world;
+    build_default_scene(world);
 
     double aspect_ratio {16.0 / 9.0};
-    int image_width {400};
+    int image_width {opts.image_width};
     
     // setup camera model
     camera cam(aspect_ratio, image_width);
     cam.defocus_angle = 0.6;
     cam.focus_dist    = 3.4;
+    cam.seed = opts.seed;
+    cam.thread_count = opts.threads;
+    cam.irradiance = make_irradiance_cache(opts.irradiance);
+
+    if (opts.headless()) {
+        cam.samples_per_pixel = opts.samples_per_pixel;
+        cam.max_depth = opts.max_depth;
+        try {
+            return render_offline(world, cam, opts);
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << '\n';
+            return 1;
+        }
+    }
+
     // get image height
     int image_height {cam.get_image_height()};  
     // create buffer to write rendered image to
@@ -40,8 +65,8 @@ int main(int, char**)
     // focal length
     double vfov = 20;
     // sampling
-    int samples_per_pixel = 2;
-    int max_depth = 2;
+    int samples_per_pixel = opts.samples_per_pixel;
+    int max_depth = opts.max_depth;
     // Setup window
     if (!glfwInit())
         return -1;
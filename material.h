@@ -11,6 +11,11 @@ class material {
                 const {
                     return false;
                 }
+
+        virtual bool is_diffuse() const {
+            // whether the irradiance cache may stand in for the light this material scatters
+            return false;
+        }
 };
 
 class lambertian : public material {
@@ -30,6 +35,8 @@ class lambertian : public material {
             return true;
         }
 
+        bool is_diffuse() const override { return true; }
+
     private:
         color albedo;
 };
@@ -41,7 +48,8 @@ class metal : public material {
         bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered)
         const override {
             vec3 reflected = reflect(r_in.direction(), rec.normal);
-            reflected = reflected + fuzz * random_unit_vector() * reflected.length();
+            // reflection preserves length, so |reflected| is the incoming ray's precomputed length
+            reflected = reflected + fuzz * random_unit_vector() * std::sqrt(r_in.length_squared());
             scattered = ray(rec.p, reflected);
             attenuation = albedo;
             return (dot(scattered.direction(), rec.normal) > 0);
@@ -61,7 +69,7 @@ class dielectric : public material {
             attenuation = color(1, 1, 1);
             double ri = rec.front_face ? (1/refraction_index) : refraction_index;
 
-            vec3 unit_direction = unit_vector(r_in.direction());
+            vec3 unit_direction = r_in.unit_direction();
             double cos_theta = std::fmin(dot(-unit_direction, rec.normal), 1.0);
             double sin_theta = std::sqrt(1 - cos_theta*cos_theta);
 
@@ -73,7 +81,8 @@ class dielectric : public material {
             else
                 direction = refract(unit_direction, rec.normal, ri);
 
-            scattered = ray(rec.p, direction);
+            // reflecting or refracting a unit vector about a unit normal keeps it unit length
+            scattered = ray::with_unit_direction(rec.p, direction);
             return true;
         }
 
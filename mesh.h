@@ -0,0 +1,362 @@
+#pragma once
+
+#include "constants.h"
+#include "hittable.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+class mesh_data {
+    // vertex and index buffers of a triangle mesh; the buffers are plain pointers so they can
+    // point straight into a memory-mapped file, and `storage` keeps whatever owns them alive
+
+    public:
+        const float* vertices = nullptr;        // xyz triples
+        const uint32_t* indices = nullptr;      // three vertex indices per triangle
+        size_t vertex_count = 0;
+        size_t triangle_count = 0;
+        shared_ptr<const void> storage;
+
+        point3 vertex(uint32_t v) const {
+            const float* p = vertices + 3 * size_t(v);
+            return point3(p[0], p[1], p[2]);
+        }
+
+        static shared_ptr<mesh_data> from_vectors(std::vector<float> vertices, std::vector<uint32_t> indices) {
+            // take ownership of in-memory buffers, e.g. from the OBJ parser
+            auto buffers = make_shared<std::pair<std::vector<float>, std::vector<uint32_t>>>(
+                std::move(vertices), std::move(indices));
+
+            auto data = make_shared<mesh_data>();
+            data->vertices = buffers->first.data();
+            data->indices = buffers->second.data();
+            data->vertex_count = buffers->first.size() / 3;
+            data->triangle_count = buffers->second.size() / 3;
+            data->storage = buffers;
+            return data;
+        }
+};
+
+class triangle_mesh : public hittable {
+    // a triangle mesh sharing its buffers with every other triangle_mesh built from the same
+    // mesh_data, with a bounding volume hierarchy over its triangles
+
+    public:
+        triangle_mesh(shared_ptr<const mesh_data> data, shared_ptr<material> mat)
+         : data(data), mat(mat)
+        {
+            build();
+        }
+
+        bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+            uint32_t hit_triangle = 0;
+            double hit_u = 0, hit_v = 0;
+            bool hit_anything = traverse<false>(r, ray_t, hit_triangle, hit_u, hit_v);
+
+            if (!hit_anything)
+                return false;
+
+            const uint32_t* tri = data->indices + 3 * size_t(hit_triangle);
+            auto p0 = data->vertex(tri[0]);
+            auto p1 = data->vertex(tri[1]);
+            auto p2 = data->vertex(tri[2]);
+
+            rec.t = ray_t.max;
+            rec.p = (1 - hit_u - hit_v) * p0 + hit_u * p1 + hit_v * p2;
+            vec3 outward_normal = unit_vector(cross(p1 - p0, p2 - p0));
+            rec.set_face_normal(r, outward_normal);
+            rec.set_normal_angle(r, outward_normal);
+            rec.mat = mat;
+
+            return true;
+        }
+
+        bool hit_any(const ray& r, interval ray_t) const override {
+            uint32_t triangle;
+            double u, v;
+            return traverse<true>(r, ray_t, triangle, u, v);
+        }
+
+        aabb bounding_box() const override {
+            if (nodes.empty())
+                return aabb();
+            return nodes[0].box();
+        }
+
+        size_t triangle_count() const { return data->triangle_count; }
+
+    private:
+        struct bvh_node {
+            float lo[3], hi[3];
+            uint32_t start;     // first triangle for a leaf, right child for an interior node
+            uint32_t count;     // number of triangles, 0 for an interior node
+            uint32_t axis;      // split axis of an interior node
+
+            aabb box() const {
+                return aabb(point3(lo[0], lo[1], lo[2]), point3(hi[0], hi[1], hi[2]));
+            }
+
+            bool hit(const ray& r, interval ray_t) const {
+                // rounding in the slab distances must never cull a triangle lying on the box
+                // boundary, or the mesh would leak where the triangle test is watertight
+                const point3& orig = r.origin();
+                const vec3& inv_dir = r.inv_direction();
+                for (int a = 0; a < 3; a++) {
+                    // pick near/far planes by direction sign rather than by comparing the
+                    // distances: an origin on a slab plane with a zero direction component
+                    // gives 0*inf = NaN, which the comparisons below then simply ignore
+                    bool negative = r.sign(a);
+                    auto t0 = ((negative ? hi[a] : lo[a]) - orig[a]) * inv_dir[a];
+                    auto t1 = ((negative ? lo[a] : hi[a]) - orig[a]) * inv_dir[a];
+                    t1 *= 1 + 4 * std::numeric_limits<double>::epsilon(); // conservative far plane
+                    ray_t.min = t0 > ray_t.min ? t0 : ray_t.min;
+                    ray_t.max = t1 < ray_t.max ? t1 : ray_t.max;
+                    if (ray_t.max < ray_t.min)
+                        return false;
+                }
+                return true;
+            }
+        };
+
+        struct watertight_ray {
+            // per-ray setup of the watertight test (Woop, Benthin, Wald 2013): shear the
+            // triangle into a space where the ray runs along +z from the origin
+            int kx, ky, kz;
+            double sx, sy, sz;
+            point3 orig;
+
+            watertight_ray(const ray& r) : orig(r.origin()) {
+                const vec3& d = r.direction();
+                kz = 0;
+                if (std::fabs(d[1]) > std::fabs(d[kz])) kz = 1;
+                if (std::fabs(d[2]) > std::fabs(d[kz])) kz = 2;
+                kx = (kz + 1) % 3;
+                ky = (kx + 1) % 3;
+                if (d[kz] < 0) std::swap(kx, ky); // preserve winding
+
+                sx = d[kx] / d[kz];
+                sy = d[ky] / d[kz];
+                sz = 1.0 / d[kz];
+            }
+        };
+
+        shared_ptr<const mesh_data> data;
+        shared_ptr<material> mat;
+        std::vector<bvh_node> nodes;
+        std::vector<uint32_t> triangle_order;   // triangle ids in leaf order
+        std::vector<float> leaf_vertices;       // corners a, b, c of the triangles in leaf order,
+                                                // as nine planes of x, y or z values (SoA)
+
+        static constexpr uint32_t max_leaf_size = 4;
+
+        template <bool any_hit>
+        bool traverse(const ray& r, interval& ray_t, uint32_t& hit_triangle, double& hit_u, double& hit_v) const {
+            // closest-hit traversal, or for `any_hit` a traversal that returns at the first
+            // triangle found
+            if (nodes.empty())
+                return false;
+
+            const watertight_ray wr(r);
+            bool hit_anything = false;
+
+            uint32_t stack[64];
+            int stack_size = 0;
+            stack[stack_size++] = 0;
+
+            while (stack_size > 0) {
+                const bvh_node& node = nodes[stack[--stack_size]];
+                if (!node.hit(r, ray_t))
+                    continue;
+
+                if (node.count > 0) {
+                    for (uint32_t i = node.start; i < node.start + node.count; i += max_leaf_size) {
+                        uint32_t lanes = std::min(max_leaf_size, node.start + node.count - i);
+                        if (intersect_leaf<any_hit>(wr, i, lanes, ray_t, hit_triangle, hit_u, hit_v)) {
+                            if (any_hit)
+                                return true;
+                            hit_anything = true;
+                        }
+                    }
+                } else {
+                    // visit the child on the near side of the split first
+                    uint32_t left = uint32_t(&node - nodes.data()) + 1;
+                    uint32_t right = node.start;
+                    if (r.sign(node.axis))
+                        std::swap(left, right);
+                    stack[stack_size++] = right;
+                    stack[stack_size++] = left;
+                }
+            }
+            return hit_anything;
+        }
+
+        template <bool any_hit>
+        bool intersect_leaf(const watertight_ray& wr, uint32_t first, uint32_t lanes, interval& ray_t,
+                            uint32_t& hit_triangle, double& hit_u, double& hit_v) const
+        {
+            // tests up to max_leaf_size consecutive triangles of a leaf at once: the first loop
+            // is straight-line arithmetic over the SoA planes with no branches, so the compiler
+            // can run the lanes in vector registers; the second picks the closest valid hit
+            const size_t n = triangle_order.size();
+            const float* plane = leaf_vertices.data() + first;
+            const float* a[3] = {plane, plane + n, plane + 2 * n};
+            const float* b[3] = {plane + 3 * n, plane + 4 * n, plane + 5 * n};
+            const float* c[3] = {plane + 6 * n, plane + 7 * n, plane + 8 * n};
+            const double ox = wr.orig[wr.kx], oy = wr.orig[wr.ky], oz = wr.orig[wr.kz];
+
+            double U[max_leaf_size], V[max_leaf_size], W[max_leaf_size];
+            double det[max_leaf_size], T[max_leaf_size];
+            for (uint32_t k = 0; k < lanes; k++) {
+                double az = a[wr.kz][k] - oz, bz = b[wr.kz][k] - oz, cz = c[wr.kz][k] - oz;
+                double ax = a[wr.kx][k] - ox - wr.sx * az;
+                double ay = a[wr.ky][k] - oy - wr.sy * az;
+                double bx = b[wr.kx][k] - ox - wr.sx * bz;
+                double by = b[wr.ky][k] - oy - wr.sy * bz;
+                double cx = c[wr.kx][k] - ox - wr.sx * cz;
+                double cy = c[wr.ky][k] - oy - wr.sy * cz;
+
+                // scaled barycentrics; an edge hit exactly by the ray counts for both neighbours
+                U[k] = cx * by - cy * bx;
+                V[k] = ax * cy - ay * cx;
+                W[k] = bx * ay - by * ax;
+                det[k] = U[k] + V[k] + W[k];
+                T[k] = wr.sz * (U[k] * az + V[k] * bz + W[k] * cz);
+            }
+
+            bool hit_anything = false;
+            for (uint32_t k = 0; k < lanes; k++) {
+                if ((U[k] < 0 || V[k] < 0 || W[k] < 0) && (U[k] > 0 || V[k] > 0 || W[k] > 0))
+                    continue;
+                if (det[k] == 0)
+                    continue;
+                double inv_det = 1.0 / det[k];
+                double t = T[k] * inv_det;
+                if (!ray_t.surrounds(t))
+                    continue;
+                if (any_hit)
+                    return true;
+                ray_t.max = t;
+                hit_triangle = triangle_order[first + k];
+                hit_u = V[k] * inv_det;
+                hit_v = W[k] * inv_det;
+                hit_anything = true;
+            }
+            return hit_anything;
+        }
+
+        void build() {
+            const size_t n = data->triangle_count;
+            if (n == 0)
+                return;
+
+            // per-triangle bounds and centroids, used only while building
+            build_input in;
+            in.centroids.resize(3 * n);
+            in.bounds.resize(6 * n);
+            float clo[3] = { infinity_f(),  infinity_f(),  infinity_f()};
+            float chi[3] = {-infinity_f(), -infinity_f(), -infinity_f()};
+            for (size_t i = 0; i < n; i++) {
+                const uint32_t* tri = data->indices + 3 * i;
+                for (int a = 0; a < 3; a++) {
+                    float v0 = data->vertices[3 * size_t(tri[0]) + a];
+                    float v1 = data->vertices[3 * size_t(tri[1]) + a];
+                    float v2 = data->vertices[3 * size_t(tri[2]) + a];
+                    float lo = std::min(v0, std::min(v1, v2));
+                    float hi = std::max(v0, std::max(v1, v2));
+                    float c = 0.5f * (lo + hi);
+                    in.bounds[6 * i + a] = lo;
+                    in.bounds[6 * i + 3 + a] = hi;
+                    in.centroids[3 * i + a] = c;
+                    clo[a] = std::min(clo[a], c);
+                    chi[a] = std::max(chi[a], c);
+                }
+            }
+
+            triangle_order.resize(n);
+            for (size_t i = 0; i < n; i++)
+                triangle_order[i] = uint32_t(i);
+
+            nodes.reserve(2 * (n / max_leaf_size) + 1);
+            build_node(0, uint32_t(n), 0, clo, chi, in);
+
+            // copy the corners into leaf order once the order is final
+            leaf_vertices.resize(9 * n);
+            for (size_t i = 0; i < n; i++) {
+                const uint32_t* tri = data->indices + 3 * size_t(triangle_order[i]);
+                for (int corner = 0; corner < 3; corner++)
+                    for (int a = 0; a < 3; a++)
+                        leaf_vertices[(3 * corner + a) * n + i] = data->vertices[3 * size_t(tri[corner]) + a];
+            }
+        }
+
+        struct build_input {
+            std::vector<float> centroids;
+            std::vector<float> bounds;
+        };
+
+        uint32_t build_node(uint32_t start, uint32_t end, int depth,
+                            const float clo[3], const float chi[3], const build_input& in)
+        {
+            // `clo`/`chi` conservatively bound the centroids in [start, end): they are only
+            // narrowed along the split axis on the way down, which avoids rescanning every
+            // triangle at every level; node boxes are then merged bottom-up
+            uint32_t index = uint32_t(nodes.size());
+            nodes.emplace_back();
+
+            bvh_node node;
+
+            // split at the centroid median of the longest axis; the traversal stack holds
+            // one entry per level, so stop splitting well before it could overflow
+            int axis = 0;
+            if (chi[1] - clo[1] > chi[axis] - clo[axis]) axis = 1;
+            if (chi[2] - clo[2] > chi[axis] - clo[axis]) axis = 2;
+
+            if (end - start <= max_leaf_size || chi[axis] <= clo[axis] || depth >= 48) {
+                for (int a = 0; a < 3; a++) {
+                    node.lo[a] = infinity_f();
+                    node.hi[a] = -infinity_f();
+                }
+                for (uint32_t i = start; i < end; i++) {
+                    size_t tri = triangle_order[i];
+                    for (int a = 0; a < 3; a++) {
+                        node.lo[a] = std::min(node.lo[a], in.bounds[6 * tri + a]);
+                        node.hi[a] = std::max(node.hi[a], in.bounds[6 * tri + 3 + a]);
+                    }
+                }
+                node.start = start;
+                node.count = end - start;
+                node.axis = 0;
+                nodes[index] = node;
+                return index;
+            }
+
+            uint32_t mid = start + (end - start) / 2;
+            std::nth_element(triangle_order.begin() + start, triangle_order.begin() + mid,
+                             triangle_order.begin() + end,
+                             [&](uint32_t x, uint32_t y) {
+                                 return in.centroids[3 * size_t(x) + axis] < in.centroids[3 * size_t(y) + axis];
+                             });
+            float split = in.centroids[3 * size_t(triangle_order[mid]) + axis];
+
+            float left_hi[3] = {chi[0], chi[1], chi[2]};
+            float right_lo[3] = {clo[0], clo[1], clo[2]};
+            left_hi[axis] = split;
+            right_lo[axis] = split;
+
+            uint32_t left = build_node(start, mid, depth + 1, clo, left_hi, in); // follows its parent
+            uint32_t right = build_node(mid, end, depth + 1, right_lo, chi, in);
+
+            for (int a = 0; a < 3; a++) {
+                node.lo[a] = std::min(nodes[left].lo[a], nodes[right].lo[a]);
+                node.hi[a] = std::max(nodes[left].hi[a], nodes[right].hi[a]);
+            }
+            node.start = right;
+            node.count = 0;
+            node.axis = uint32_t(axis);
+            nodes[index] = node;
+            return index;
+        }
+
+        static float infinity_f() { return std::numeric_limits<float>::infinity(); }
+};
@@ -0,0 +1,215 @@
+#pragma once
+
+#include "mesh.h"
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+class mapped_file {
+    // read-only memory mapping of a whole file, unmapped on destruction
+
+    public:
+        explicit mapped_file(const std::string& path) {
+            int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0)
+                throw std::runtime_error("cannot open " + path);
+
+            struct stat st;
+            if (::fstat(fd, &st) != 0) {
+                ::close(fd);
+                throw std::runtime_error("cannot stat " + path);
+            }
+
+            size = size_t(st.st_size);
+            if (size > 0) {
+                void* p = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (p == MAP_FAILED) {
+                    ::close(fd);
+                    throw std::runtime_error("cannot map " + path);
+                }
+                addr = static_cast<const char*>(p);
+            }
+            ::close(fd); // the mapping stays valid after the descriptor is closed
+        }
+
+        ~mapped_file() {
+            if (addr)
+                ::munmap(const_cast<char*>(addr), size);
+        }
+
+        mapped_file(const mapped_file&) = delete;
+        mapped_file& operator=(const mapped_file&) = delete;
+
+        const char* data() const { return addr; }
+        size_t length() const { return size; }
+
+    private:
+        const char* addr = nullptr;
+        size_t size = 0;
+};
+
+// Binary mesh layout (native byte order, little-endian on every platform we build for):
+//   binary_mesh_header
+//   float    vertices[3 * vertex_count]
+//   uint32_t indices[3 * triangle_count]
+// Both arrays are 4-byte aligned within the file, so a mapping can be used in place.
+struct binary_mesh_header {
+    char magic[8];              // "RTMESH1\0"
+    uint32_t version;
+    uint32_t vertex_count;
+    uint32_t triangle_count;
+    uint32_t reserved;
+};
+
+static const char binary_mesh_magic[8] = {'R', 'T', 'M', 'E', 'S', 'H', '1', '\0'};
+static const uint32_t binary_mesh_version = 1;
+
+inline shared_ptr<mesh_data> load_binary_mesh(const std::string& path) {
+    // map the file and point the mesh buffers straight into the mapping (no copies)
+    auto file = make_shared<mapped_file>(path);
+
+    binary_mesh_header header;
+    if (file->length() < sizeof(header))
+        throw std::runtime_error(path + ": truncated mesh header");
+    std::memcpy(&header, file->data(), sizeof(header));
+
+    if (std::memcmp(header.magic, binary_mesh_magic, sizeof(header.magic)) != 0
+        || header.version != binary_mesh_version)
+        throw std::runtime_error(path + ": not a binary mesh");
+
+    size_t vertex_bytes = size_t(header.vertex_count) * 3 * sizeof(float);
+    size_t index_bytes = size_t(header.triangle_count) * 3 * sizeof(uint32_t);
+    if (file->length() != sizeof(header) + vertex_bytes + index_bytes)
+        throw std::runtime_error(path + ": mesh size does not match its header");
+
+    auto data = make_shared<mesh_data>();
+    data->vertices = reinterpret_cast<const float*>(file->data() + sizeof(header));
+    data->indices = reinterpret_cast<const uint32_t*>(file->data() + sizeof(header) + vertex_bytes);
+    data->vertex_count = header.vertex_count;
+    data->triangle_count = header.triangle_count;
+    data->storage = file;
+
+    // a single linear pass, so a corrupt file fails here rather than during rendering
+    for (size_t i = 0; i < 3 * data->triangle_count; i++) {
+        if (data->indices[i] >= data->vertex_count)
+            throw std::runtime_error(path + ": vertex index out of range");
+    }
+
+    return data;
+}
+
+inline void write_binary_mesh(const std::string& path, const mesh_data& data) {
+    binary_mesh_header header;
+    std::memcpy(header.magic, binary_mesh_magic, sizeof(header.magic));
+    header.version = binary_mesh_version;
+    header.vertex_count = uint32_t(data.vertex_count);
+    header.triangle_count = uint32_t(data.triangle_count);
+    header.reserved = 0;
+
+    FILE* out = std::fopen(path.c_str(), "wb");
+    if (!out)
+        throw std::runtime_error("cannot write " + path);
+
+    bool ok = std::fwrite(&header, sizeof(header), 1, out) == 1
+           && std::fwrite(data.vertices, sizeof(float), 3 * data.vertex_count, out) == 3 * data.vertex_count
+           && std::fwrite(data.indices, sizeof(uint32_t), 3 * data.triangle_count, out) == 3 * data.triangle_count;
+    ok = (std::fclose(out) == 0) && ok;
+    if (!ok)
+        throw std::runtime_error("failed writing " + path);
+}
+
+inline shared_ptr<mesh_data> load_obj(const std::string& path) {
+    // minimal Wavefront OBJ reader: `v` and `f` records only; faces may use the v/vt/vn
+    // forms and negative (relative) indices, and polygons are split into triangle fans
+    mapped_file file(path);
+
+    std::vector<float> vertices;
+    std::vector<uint32_t> indices;
+    std::vector<uint32_t> face;
+
+    const char* p = file.data();
+    const char* end = p + file.length();
+
+    auto skip_blanks = [&]() { while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) p++; };
+    auto skip_line = [&]() { while (p < end && *p != '\n') p++; if (p < end) p++; };
+    auto is_digit = [&]() { return p < end && *p >= '0' && *p <= '9'; };
+    auto parse_float = [&]() {
+        // strtof would need a terminated string; the mapping is not, so parse by hand. A
+        // missing or malformed number (no mantissa digits, a bare exponent, trailing junk) is
+        // an error rather than a silent zero
+        skip_blanks();
+        double sign = 1, value = 0, scale = 1;
+        int digits = 0;
+        if (p < end && (*p == '-' || *p == '+')) { if (*p == '-') sign = -1; p++; }
+        for (; is_digit(); digits++) value = value * 10 + (*p++ - '0');
+        if (p < end && *p == '.') {
+            p++;
+            for (; is_digit(); digits++) { value = value * 10 + (*p++ - '0'); scale *= 10; }
+        }
+        value /= scale;
+        bool ok = digits > 0;
+        if (ok && p < end && (*p == 'e' || *p == 'E')) {
+            p++;
+            int exp_sign = 1, exponent = 0;
+            if (p < end && (*p == '-' || *p == '+')) { if (*p == '-') exp_sign = -1; p++; }
+            ok = is_digit();
+            while (is_digit()) exponent = exponent * 10 + (*p++ - '0');
+            value *= std::pow(10.0, exp_sign * exponent);
+        }
+        if (!ok || (p < end && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n'))
+            throw std::runtime_error(path + ": bad vertex");
+        return float(sign * value);
+    };
+
+    while (p < end) {
+        skip_blanks();
+        if (end - p >= 2 && p[0] == 'v' && (p[1] == ' ' || p[1] == '\t')) {
+            p += 1;
+            for (int a = 0; a < 3; a++)
+                vertices.push_back(parse_float());
+        } else if (end - p >= 2 && p[0] == 'f' && (p[1] == ' ' || p[1] == '\t')) {
+            p += 1;
+            face.clear();
+            while (true) {
+                skip_blanks();
+                if (p >= end || *p == '\n' || *p == '#')
+                    break;
+
+                long sign = 1, index = 0;
+                if (*p == '-') { sign = -1; p++; }
+                while (p < end && *p >= '0' && *p <= '9') index = index * 10 + (*p++ - '0');
+                while (p < end && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n') p++; // skip /vt/vn
+
+                long vertex_count = long(vertices.size() / 3);
+                long resolved = sign < 0 ? vertex_count - index : index - 1;
+                if (index == 0 || resolved < 0 || resolved >= vertex_count)
+                    throw std::runtime_error(path + ": bad face index");
+                face.push_back(uint32_t(resolved));
+            }
+            for (size_t k = 2; k < face.size(); k++) {
+                indices.push_back(face[0]);
+                indices.push_back(face[k - 1]);
+                indices.push_back(face[k]);
+            }
+        }
+        skip_line();
+    }
+
+    return mesh_data::from_vectors(std::move(vertices), std::move(indices));
+}
+
+inline shared_ptr<mesh_data> load_mesh(const std::string& path) {
+    // pick the loader from the file extension; anything that is not .obj is read as binary
+    auto dot = path.rfind('.');
+    if (dot != std::string::npos && path.compare(dot, std::string::npos, ".obj") == 0)
+        return load_obj(path);
+    return load_binary_mesh(path);
+}
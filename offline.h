@@ -0,0 +1,64 @@
+#pragma once
+
+#include "render.h"
+#include "checkpoint.h"
+#include "options.h"
+#include "tile_farm.h"
+#include "animation.h"
+
+#include <chrono>
+#include <memory>
+
+inline int render_offline(const hittable& world, camera& cam, const render_options& opts) {
+    // headless render of a single frame to a ppm file, with optional checkpoint/resume
+    using clock = std::chrono::steady_clock;
+
+    if (!opts.camera_path.empty()) {
+        render_animation(world, cam, camera_path::load(opts.camera_path), opts.frames, opts.output);
+        return 0;
+    }
+
+    int image_width = cam.image_width;
+    int image_height = cam.get_image_height();
+    film image(image_width, image_height);
+
+    std::unique_ptr<render_checkpoint> checkpoint;
+    if (!opts.checkpoint.empty()) {
+        checkpoint = std::make_unique<render_checkpoint>(
+            opts.checkpoint, image_width, image_height, cam.seed, cam.max_depth, cam.fingerprint(world),
+            opts.resume);
+        if (opts.resume) {
+            int passes = checkpoint->restore(image);
+            std::clog << "resuming after " << passes << " of " << cam.samples_per_pixel << " passes\n";
+        }
+    }
+
+    auto start = clock::now();
+    auto last_checkpoint = start;
+    if (opts.farm_workers > 0) {
+        auto stats = render_farm(world, cam, image, opts.farm_workers, opts.tile_size,
+                                 opts.farm_tile_timeout, opts.farm_crash_after);
+        print_farm_stats(std::clog, stats);
+    } else {
+        cam.render(world, image, [&](const film& f, int pass) {
+            if (!checkpoint)
+                return;
+            auto now = clock::now();
+            if (std::chrono::duration<double>(now - last_checkpoint).count() >= opts.checkpoint_interval
+                && checkpoint->save_async(f, pass))
+                last_checkpoint = now;
+        });
+    }
+    if (checkpoint)
+        checkpoint->save(image, int(image.min_samples()));
+
+    if (cam.irradiance)
+        cam.irradiance->report(std::clog);
+    std::clog << "rendered " << image_width << 'x' << image_height << " at " << cam.samples_per_pixel
+              << " spp in " << std::chrono::duration<double>(clock::now() - start).count() << " s\n";
+
+    std::vector<uint32_t> buffer(size_t(image_width) * image_height);
+    image.resolve(buffer);
+    write_to_ppm(image_width, image_height, buffer, opts.output);
+    return 0;
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include "irradiance_cache.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+
+struct render_options {
+    // command line settings; without --output the interactive viewer is started
+    std::string output;                 // headless render target (.ppm), a pattern in batch mode
+    int image_width = 400;
+    int samples_per_pixel = 2;
+    int max_depth = 2;
+    uint64_t seed = 0;
+    int threads = 0;                    // 0 = one per hardware thread
+
+    std::string checkpoint;             // checkpoint file, empty = no checkpoints
+    double checkpoint_interval = 60;    // seconds between checkpoints
+    bool resume = false;                // continue from the checkpoint file
+
+    int farm_workers = 0;               // worker processes for a tile farm render, 0 = in-process
+    int tile_size = 32;
+    double farm_tile_timeout = 300;     // seconds a farm worker may hold a tile before it is killed
+    int farm_crash_after = -1;          // make worker 0 exit after n tiles (tests the requeue path)
+
+    std::string camera_path;            // keyframe file; renders a frame sequence (batch mode)
+    int frames = 0;                     // frames spread over the path, 0 = one per keyframe
+
+    std::string server_socket;          // run as a render server on this Unix domain socket
+    int server_jobs = 1;                // jobs rendered concurrently by the server
+    int scene_cache = 8;                // scenes kept resident by the server
+
+    irradiance_cache_settings irradiance;   // reuse diffuse bounce estimates (see irradiance_cache.h)
+
+    bool headless() const { return !output.empty(); }
+};
+
+inline const char* render_usage =
+    "usage: raytracer [--output file.ppm] [--width n] [--spp n] [--depth n] [--seed n]\n"
+    "                 [--threads n] [--checkpoint file] [--checkpoint-interval s] [--resume]\n"
+    "                 [--farm workers] [--tile-size n] [--farm-tile-timeout s]\n"
+    "                 [--farm-crash-after n]\n"
+    "                 [--camera-path file [--frames n]]\n"
+    "                 [--server socket [--server-jobs n] [--scene-cache n]]\n"
+    "                 [--irradiance-cache [--ic-cell-size d] [--ic-max-error x] [--ic-min-samples n]\n"
+    "                                     [--ic-budget-mb n]]\n";
+
+inline bool find_frame_conversion(const std::string& pattern, size_t& begin, size_t& end, int& width) {
+    // locates the frame number in a batch output pattern: at most one "%d" or "%0Nd", and no
+    // other '%' sequence, since the pattern is substituted by hand rather than by printf
+    bool found = false;
+    for (size_t i = pattern.find('%'); i != std::string::npos; i = pattern.find('%', i)) {
+        size_t j = i + 1;
+        int digits = 0;
+        if (j < pattern.size() && pattern[j] == '0') {
+            for (j++; j < pattern.size() && pattern[j] >= '0' && pattern[j] <= '9'; j++)
+                digits = std::min(32, digits * 10 + (pattern[j] - '0'));
+            if (digits == 0)
+                j = pattern.size();     // "%0" without a width
+        }
+        if (j >= pattern.size() || pattern[j] != 'd')
+            throw std::runtime_error("output pattern " + pattern + ": only %d or %0Nd is supported");
+        if (found)
+            throw std::runtime_error("output pattern " + pattern + ": more than one frame number");
+        found = true;
+        begin = i;
+        end = j + 1;
+        width = digits;
+        i = end;
+    }
+    return found;
+}
+
+inline render_options parse_options(int argc, char** argv) {
+    render_options opts;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc)
+                throw std::runtime_error("missing value for " + arg);
+            return argv[++i];
+        };
+
+        if (arg == "--output")                      opts.output = value();
+        else if (arg == "--width")                  opts.image_width = std::stoi(value());
+        else if (arg == "--spp")                    opts.samples_per_pixel = std::stoi(value());
+        else if (arg == "--depth")                  opts.max_depth = std::stoi(value());
+        else if (arg == "--seed")                   opts.seed = std::stoull(value());
+        else if (arg == "--threads")                opts.threads = std::stoi(value());
+        else if (arg == "--checkpoint")             opts.checkpoint = value();
+        else if (arg == "--checkpoint-interval")    opts.checkpoint_interval = std::stod(value());
+        else if (arg == "--resume")                 opts.resume = true;
+        else if (arg == "--farm")                   opts.farm_workers = std::stoi(value());
+        else if (arg == "--tile-size")              opts.tile_size = std::stoi(value());
+        else if (arg == "--farm-tile-timeout")      opts.farm_tile_timeout = std::stod(value());
+        else if (arg == "--farm-crash-after")       opts.farm_crash_after = std::stoi(value());
+        else if (arg == "--camera-path")            opts.camera_path = value();
+        else if (arg == "--frames")                 opts.frames = std::stoi(value());
+        else if (arg == "--server")                 opts.server_socket = value();
+        else if (arg == "--server-jobs")            opts.server_jobs = std::stoi(value());
+        else if (arg == "--scene-cache")            opts.scene_cache = std::stoi(value());
+        else if (opts.irradiance.parse_flag(arg, value)) {}
+        else
+            throw std::runtime_error("unknown option " + arg);
+    }
+
+    if (opts.resume && opts.checkpoint.empty())
+        throw std::runtime_error("--resume needs --checkpoint");
+    if (opts.farm_workers > 0 && !opts.checkpoint.empty())
+        throw std::runtime_error("--checkpoint is not supported with --farm");
+    if (!opts.camera_path.empty() && (opts.output.empty() || opts.farm_workers > 0 || !opts.checkpoint.empty()))
+        throw std::runtime_error("--camera-path needs --output and does not combine with --farm or --checkpoint");
+    if (!opts.camera_path.empty()) {
+        size_t begin, end;
+        int width;
+        find_frame_conversion(opts.output, begin, end, width);
+    }
+    if (opts.irradiance.enabled && !opts.checkpoint.empty())
+        throw std::runtime_error("--irradiance-cache does not combine with --checkpoint: cached estimates "
+                                 "depend on thread timing, so a resumed render would not match");
+    opts.irradiance.validate();
+    if (opts.scene_cache < 1)
+        throw std::runtime_error("--scene-cache must be positive");
+    if (opts.tile_size < 1)
+        throw std::runtime_error("--tile-size must be positive");
+    if (opts.farm_tile_timeout <= 0)
+        throw std::runtime_error("--farm-tile-timeout must be positive");
+    return opts;
+}
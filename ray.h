@@ -3,13 +3,39 @@
 #include "vec3.h"
 
 class ray {
+    // besides origin and direction, a ray carries values every intersection test would
+    // otherwise recompute: |direction|^2 for the sphere quadratic, and the reciprocal
+    // direction and its sign bits for slab tests against bounding boxes
+
     public:
         ray() {}
-        ray(const point3& origin, const vec3& direction) : orig(origin), dir(direction) {}
+        ray(const point3& origin, const vec3& direction) : orig(origin), dir(direction) {
+            precompute(direction.length_squared());
+        }
+
+        static ray with_unit_direction(const point3& origin, const vec3& unit_direction) {
+            // for directions already known to be normalized; lets hit tests drop the division
+            // by |direction|^2
+            ray r;
+            r.orig = origin;
+            r.dir = unit_direction;
+            r.unit = true;
+            r.precompute(1.0);
+            return r;
+        }
 
         const point3& origin() const { return orig; }
         const vec3& direction() const { return dir; }
 
+        double length_squared() const { return dir_length_squared; }
+        const vec3& inv_direction() const { return inv_dir; }
+        int sign(int axis) const { return dir_sign[axis]; }    // 1 if the direction is negative along axis
+        bool has_unit_direction() const { return unit; }
+
+        vec3 unit_direction() const {
+            return unit ? dir : dir / std::sqrt(dir_length_squared);
+        }
+
         point3 at(double t) const {
             return orig + t*dir;
         }
@@ -17,4 +43,16 @@ class ray {
     private:
         point3 orig;
         vec3 dir;
+        vec3 inv_dir;
+        double dir_length_squared = 0;
+        int dir_sign[3] = {0, 0, 0};
+        bool unit = false;
+
+        void precompute(double length_sq) {
+            dir_length_squared = length_sq;
+            inv_dir = vec3(1.0 / dir.x(), 1.0 / dir.y(), 1.0 / dir.z());
+            dir_sign[0] = inv_dir.x() < 0;
+            dir_sign[1] = inv_dir.y() < 0;
+            dir_sign[2] = inv_dir.z() < 0;
+        }
 };
@@ -4,9 +4,18 @@
 #include "hittable.h"
 #include "hittable_list.h"
 #include "sphere.h"
+#include "instance.h"
+#include "mesh.h"
 #include "material.h"
+#include "film.h"
+#include "irradiance_cache.h"
 
+#include <atomic>
+#include <cstring>
 #include <fstream>
+#include <functional>
+#include <stdexcept>
+#include <thread>
 
 class camera {
     public:
@@ -24,6 +33,10 @@ class camera {
         double defocus_angle = 0;
         double focus_dist = 1;
 
+        uint64_t seed = 0;                  // base seed; sample s of pixel p always uses the same stream
+        int thread_count = 0;               // render threads, 0 = one per hardware thread
+        shared_ptr<irradiance_cache> irradiance;    // optional cache for secondary diffuse bounces
+
         camera(): aspect_ratio(1.0), image_width(100) {
             initialize();
         }
@@ -33,31 +46,103 @@ class camera {
         }
 
         int get_image_height() const {
-            return image_height;
+            // derived from the current settings, so it is right even before the next initialize()
+            int height = int(image_width / aspect_ratio);
+            return (height < 1) ? 1 : height;
         }
         
         void render(const hittable& world, std::vector<u_int32_t>& buffer) {
             initialize();
-            
-            // render and write to buffer
-            for (int j = 0; j < image_height; j++) {
-                for (int i = 0; i < image_width; i++) {
-                    // auto pixel_center = pixel00_loc + (i * pixel_delta_u) + (j * pixel_delta_v);
-                    // auto ray_direction = pixel_center - center;
-                    // ray r(center, ray_direction);
-                    // // color the pixel according to the ray vector
-                    // color pixel_color = ray_color(r, world);
-                    // write_color(buffer, i, j, image_width, pixel_color);
-
-                    color pixel_color(0,0,0);
-                    for (int sample = 0; sample < samples_per_pixel; sample++) {
-                        ray r = get_ray(i, j);
-                        pixel_color += ray_color(r, max_depth, world);
+
+            film image(image_width, image_height);
+            render(world, image);
+            image.resolve(buffer);
+        }
+
+        void render(const hittable& world, film& image,
+                    const std::function<void(const film&, int)>& on_pass = nullptr) {
+            // progressive render: every pass adds one sample to each pixel, continuing from
+            // whatever the film already holds (e.g. a resumed checkpoint); `on_pass` runs
+            // between passes, while no render thread touches the film
+            initialize();
+
+            for (int pass = int(image.min_samples()) + 1; pass <= samples_per_pixel; pass++) {
+                render_region(world, image, 0, 0, image_width, image_height, pass);
+                if (on_pass)
+                    on_pass(image, pass);
+            }
+        }
+
+        void render_region(const hittable& world, film& image, int x0, int y0, int x1, int y1,
+                           int target_samples) {
+            // bring every pixel in [x0, x1) x [y0, y1) up to `target_samples`, rows spread
+            // over the render threads; `image` is the whole frame or a film placed over the region
+            initialize();
+
+            int threads = thread_count > 0 ? thread_count : int(std::thread::hardware_concurrency());
+            threads = std::max(1, std::min(threads, y1 - y0));
+
+            std::atomic<int> next_row(y0);
+            auto worker = [&]() {
+                for (int j = next_row++; j < y1; j = next_row++)
+                    for (int i = x0; i < x1; i++)
+                        render_pixel(world, image, i, j, target_samples);
+            };
+
+            std::vector<std::thread> pool;
+            for (int t = 1; t < threads; t++)
+                pool.emplace_back(worker);
+            worker();
+            for (auto& t : pool)
+                t.join();
+        }
+
+        uint64_t fingerprint(const hittable& world) {
+            // identifies the image this camera converges to in `world`: the view settings, plus
+            // the first hit of a coarse grid of pinhole rays and one fixed-seed scatter there,
+            // standing in for the scene's geometry and materials. Sample count, depth and seed
+            // are left to the caller.
+            initialize();
+
+            uint64_t hash = 0;
+            auto mix = [&hash](double x) {
+                uint64_t bits;
+                std::memcpy(&bits, &x, sizeof(bits));
+                hash = mix_bits(hash ^ bits);
+            };
+            for (double x : {aspect_ratio, double(image_width), vfov, defocus_angle, focus_dist})
+                mix(x);
+            for (const vec3& e : {lookfrom, lookat, vup})
+                for (int axis = 0; axis < 3; axis++)
+                    mix(e[axis]);
+
+            const int probes = 16;
+            for (int pj = 0; pj < probes; pj++) {
+                for (int pi = 0; pi < probes; pi++) {
+                    auto target = pixel00_loc + ((pi + 0.5) * image_width / probes - 0.5) * pixel_delta_u
+                                              + ((pj + 0.5) * image_height / probes - 0.5) * pixel_delta_v;
+                    ray probe(center, target - center);
+                    hit_record rec;
+                    if (world.hit(probe, interval(0.001, infinity), rec)) {
+                        mix(rec.t);
+                        for (int axis = 0; axis < 3; axis++)
+                            mix(rec.normal[axis]);
+
+                        seed_random(mix_bits(uint64_t(pj * probes + pi)));
+                        color attenuation;
+                        ray scattered;
+                        bool scatters = rec.mat && rec.mat->scatter(probe, rec, attenuation, scattered);
+                        mix(scatters);
+                        for (int axis = 0; scatters && axis < 3; axis++) {
+                            mix(attenuation[axis]);
+                            mix(scattered.direction()[axis]);
+                        }
+                    } else {
+                        mix(-1);
                     }
-                    write_color(buffer, i, j, image_width, pixel_samples_scale * pixel_color);
                 }
-            }   
-
+            }
+            return hash;
         }
 
         ray get_ray(int i, int j) const {
@@ -88,7 +173,6 @@ class camera {
 
     private:
         int image_height;           // rendered image height
-        double pixel_samples_scale; // scaling factor for rgb values
         point3 center;              // camera center
         point3 pixel00_loc;         // location of pixel (0, 0) 
         vec3 pixel_delta_u;         // pixel spacing in horizontal
@@ -101,9 +185,6 @@ class camera {
             image_height = int(image_width / aspect_ratio);
             image_height = (image_height < 1) ? 1 : image_height;
             
-            // calculate scaling factor for rgb values
-            pixel_samples_scale = 1.0 / samples_per_pixel;
-
             center = lookfrom;
 
             // viewport parameters
@@ -133,7 +214,20 @@ class camera {
             defocus_disk_v = v * defocus_radius;
         }
 
-        color ray_color(const ray& r, int depth, const hittable& world) const {
+        void render_pixel(const hittable& world, film& image, int i, int j, int target_samples) const {
+            // each sample reseeds the generator from (seed, pixel, sample index), so a pixel's
+            // result does not depend on thread scheduling or on where a render was resumed
+            size_t index = size_t(j) * image_width + i;
+            size_t slot = size_t(j - image.y0) * image.width + (i - image.x0);  // the film may be a tile
+            for (uint32_t s = image.samples[slot]; s < uint32_t(target_samples); s++) {
+                seed_random(seed + mix_bits((uint64_t(index) << 32) | s));
+                ray r = get_ray(i, j);
+                image.add_sample(slot, ray_color(r, max_depth, world));
+            }
+        }
+
+        color ray_color(const ray& r, int depth, const hittable& world, bool* from_cache = nullptr) const {
+            // `from_cache` is set when the result came from an irradiance cache lookup
             // if ray bounces are exceeded, no more light is gathered
             if (depth <= 0 )
                 return color(0,0,0);
@@ -143,12 +237,32 @@ class camera {
             if (world.hit(r, interval(0.001, infinity), rec)){
                 ray scattered;
                 color attenuation;
-                if (rec.mat->scatter(r, rec, attenuation, scattered))
+                if (!rec.mat->scatter(r, rec, attenuation, scattered))
+                    return color(0,0,0);
+
+                // the cache only serves the primary hit (which records) and the first bounce
+                // after it (which records, or ends the path at a converged cell): cutting the
+                // path there saves the most, and deeper hits would mostly add cache misses
+                if (!irradiance || !rec.mat->is_diffuse() || depth < max_depth - 1)
                     return attenuation * ray_color(scattered, depth-1, world);
-                return color(0,0,0);
+
+                color incoming;
+                if (depth < max_depth && irradiance->lookup(rec.p, rec.normal, incoming)) {
+                    if (from_cache)
+                        *from_cache = true;
+                    return attenuation * incoming;
+                }
+
+                // a value that came out of the cache is not a new sample, and recording it would
+                // shrink the cell's error estimate
+                bool reused = false;
+                incoming = ray_color(scattered, depth-1, world, &reused);
+                if (!reused)
+                    irradiance->record(rec.p, rec.normal, incoming);
+                return attenuation * incoming;
             }
             
-            vec3 unit_direction = unit_vector(r.direction());
+            vec3 unit_direction = r.unit_direction();
             auto a = 0.5 * (unit_direction.y() + 1.0);
             return (1.0 - a) * color(1.0, 1.0, 1.0) + a * color(0.5, 0.7, 1.0);
         }
@@ -156,6 +270,8 @@ class camera {
 
 void write_to_ppm(int image_width, int image_height, const std::vector<uint32_t>& buffer, const std::string& filename) {
     std::ofstream out(filename);
+    if (!out)
+        throw std::runtime_error("cannot open " + filename + " for writing");
     out << "P3\n" << image_width << ' ' << image_height << "\n255\n";
 
     for (int j = 0; j < image_height; j++) {
@@ -172,5 +288,7 @@ void write_to_ppm(int image_width, int image_height, const std::vector<uint32_t>
         }
     }
     out.close();
+    if (!out)
+        throw std::runtime_error("failed writing " + filename);
 }
 
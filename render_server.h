@@ -0,0 +1,561 @@
+#pragma once
+
+#include "render.h"
+#include "scenes.h"
+#include "mesh_io.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <list>
+#include <map>
+#include <mutex>
+#include <queue>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Persistent render server on a Unix domain socket. Clients send one command per line:
+//
+//   render scene=<id> output=<file.ppm> [lookfrom=x,y,z] [lookat=x,y,z] [vfov=d] [spp=n]
+//          [depth=n] [width=n] [seed=n] [priority=n]   -> "queued <job>"
+//   status <job>                                   -> "queued|running|done|failed <job> ..."
+//   stats                                          -> cache and per-job latency metrics, ending in "end"
+//   shutdown                                       -> "bye"
+//
+// On shutdown running jobs finish, queued ones are marked failed, and open connections are
+// closed once their current command is answered. Only the most recent finished jobs are kept
+// for status and stats.
+//
+// Scene ids are the reference scene names from scenes.h, "default", or mesh:<path> for an OBJ or
+// binary mesh. Parsed scenes (with their acceleration structures) are kept in an LRU cache keyed
+// by a content hash, so repeated jobs on a scene skip the load and the BVH build.
+
+inline uint64_t fnv1a(const void* data, size_t size, uint64_t hash = 0xcbf29ce484222325ULL) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash ^= p[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+struct cached_scene {
+    hittable_list world;
+    camera view;                // the scene's default camera; jobs override parts of it
+};
+
+class scene_cache {
+    // least-recently-used cache of built scenes keyed by content hash
+
+    public:
+        explicit scene_cache(size_t capacity) : capacity(capacity) {}
+
+        shared_ptr<const cached_scene> get(const std::string& id, bool& hit) {
+            uint64_t key = content_hash(id);
+
+            std::promise<shared_ptr<const cached_scene>> building;
+            std::shared_future<shared_ptr<const cached_scene>> scene;
+            uint64_t serial = 0;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                auto found = index.find(key);
+                hit = found != index.end();
+                if (hit) {
+                    // a scene still being built by another job counts as a hit: this job
+                    // waits for that build instead of repeating it
+                    entries.splice(entries.begin(), entries, found->second);
+                    hits++;
+                    scene = found->second->scene;
+                } else {
+                    misses++;
+                    serial = ++inserted;
+                    scene = building.get_future().share();
+                    entries.push_front({key, serial, scene});
+                    index[key] = entries.begin();
+                    evict();
+                }
+            }
+
+            if (!hit) {
+                // build outside the lock so other scenes stay available meanwhile
+                try {
+                    building.set_value(build(id));
+                } catch (...) {
+                    building.set_exception(std::current_exception());
+                    std::lock_guard<std::mutex> lock(mutex);
+                    auto found = index.find(key);
+                    if (found != index.end() && found->second->serial == serial) {
+                        entries.erase(found->second);
+                        index.erase(found);
+                    }
+                }
+            }
+            return scene.get();
+        }
+
+        void report(std::ostream& out) {
+            std::lock_guard<std::mutex> lock(mutex);
+            out << "cache entries=" << entries.size() << " capacity=" << capacity
+                << " hits=" << hits << " misses=" << misses << '\n';
+        }
+
+    private:
+        struct entry {
+            uint64_t key;
+            uint64_t serial;    // tells a failed build's entry apart from a later retry
+            std::shared_future<shared_ptr<const cached_scene>> scene;
+        };
+
+        size_t capacity;
+        std::mutex mutex;
+        std::list<entry> entries;   // most recently used first
+        std::unordered_map<uint64_t, std::list<entry>::iterator> index;
+        long long hits = 0;
+        long long misses = 0;
+        uint64_t inserted = 0;
+
+        void evict() {
+            // caller holds the mutex; jobs already holding an evicted scene keep it alive
+            while (entries.size() > capacity) {
+                index.erase(entries.back().key);
+                entries.pop_back();
+            }
+        }
+
+        struct file_identity {
+            dev_t device;
+            ino_t inode;
+            off_t size;
+            timespec modified;
+            uint64_t hash;      // content hash while the fields above stay the same
+        };
+        std::unordered_map<std::string, file_identity> hashed_files;   // guarded by `mutex`
+
+        uint64_t content_hash(const std::string& id) {
+            // builtin scenes are defined by code, so their name (plus a version bump when the
+            // code changes) is their content; mesh scenes hash the file bytes, so an edited
+            // file is a different cache entry even at the same path. The bytes are only read
+            // again when the file's identity (inode, size, mtime) changes
+            if (id.rfind("mesh:", 0) != 0) {
+                std::string tagged = "builtin-v1:" + id;
+                return fnv1a(tagged.data(), tagged.size());
+            }
+
+            std::string path = id.substr(5);
+            struct stat st;
+            if (::stat(path.c_str(), &st) != 0)
+                throw std::runtime_error("cannot open " + path);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                auto found = hashed_files.find(path);
+                if (found != hashed_files.end() && same_identity(found->second, st))
+                    return found->second.hash;
+            }
+
+            mapped_file file(path);
+            uint64_t hash = word_hash(file.data(), file.length());
+            std::lock_guard<std::mutex> lock(mutex);
+            hashed_files[path] = {st.st_dev, st.st_ino, st.st_size, st.st_mtim, hash};
+            return hash;
+        }
+
+        static bool same_identity(const file_identity& f, const struct stat& st) {
+            return f.device == st.st_dev && f.inode == st.st_ino && f.size == st.st_size
+                && f.modified.tv_sec == st.st_mtim.tv_sec && f.modified.tv_nsec == st.st_mtim.tv_nsec;
+        }
+
+        static uint64_t word_hash(const char* data, size_t size) {
+            // eight bytes per step, so hashing a large mesh costs about as much as reading it
+            uint64_t hash = fnv1a("mesh", 4);
+            size_t words = size / 8;
+            for (size_t i = 0; i < words; i++) {
+                uint64_t word;
+                std::memcpy(&word, data + 8 * i, sizeof(word));
+                hash = mix_bits(hash ^ word);
+            }
+            return fnv1a(data + 8 * words, size - 8 * words, hash);
+        }
+
+        static shared_ptr<const cached_scene> build(const std::string& id) {
+            auto scene = make_shared<cached_scene>();
+            if (id == "default") {
+                build_default_scene(scene->world);
+                scene->view.lookfrom = point3(13, 2, 3);
+                scene->view.defocus_angle = 0.6;
+                scene->view.focus_dist = 3.4;
+            } else if (id.rfind("mesh:", 0) == 0) {
+                auto mesh = make_shared<triangle_mesh>(load_mesh(id.substr(5)),
+                                                       make_shared<lambertian>(color(0.7, 0.7, 0.7)));
+                auto box = mesh->bounding_box();
+                point3 mid(0.5 * (box.x.min + box.x.max), 0.5 * (box.y.min + box.y.max), 0.5 * (box.z.min + box.z.max));
+                double extent = std::fmax(box.x.size(), std::fmax(box.y.size(), box.z.size()));
+                scene->world.add(mesh);
+                scene->view.lookat = mid;
+                scene->view.lookfrom = mid + vec3(0, 0.3, 1.5) * extent;
+                scene->view.vfov = 40;
+            } else if (!build_reference_scene(id, scene->world, scene->view)) {
+                throw std::runtime_error("unknown scene " + id);
+            }
+            return scene;
+        }
+};
+
+struct render_job {
+    int id;
+    int priority = 0;
+    std::string scene;
+    std::string output;
+    std::map<std::string, std::string> params;
+
+    std::string state = "queued";
+    std::string error;
+    bool cache_hit = false;
+    std::chrono::steady_clock::time_point submitted, started, finished;
+};
+
+class render_server {
+    public:
+        render_server(const std::string& socket_path, int job_workers, int threads, size_t cache_capacity)
+         : socket_path(socket_path), job_workers(std::max(1, job_workers)), cache(cache_capacity)
+        {
+            // split the render threads between the jobs that run at the same time
+            int hw = threads > 0 ? threads : int(std::thread::hardware_concurrency());
+            threads_per_job = std::max(1, hw / this->job_workers);
+        }
+
+        int run() {
+            int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+            sockaddr_un addr = {};
+            addr.sun_family = AF_UNIX;
+            if (listener < 0 || socket_path.size() >= sizeof(addr.sun_path))
+                throw std::runtime_error("cannot create socket " + socket_path);
+            std::strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+
+            // jobs write files with the server's privileges, so only its own user may connect;
+            // the socket file takes its mode from the umask at bind time
+            ::unlink(socket_path.c_str());
+            mode_t old_mask = ::umask(0077);
+            int bound = ::bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+            ::umask(old_mask);
+            if (bound != 0 || ::listen(listener, 16) != 0) {
+                ::close(listener);
+                throw std::runtime_error("cannot listen on " + socket_path);
+            }
+            std::clog << "render server listening on " << socket_path << " (" << job_workers
+                      << " concurrent jobs, " << threads_per_job << " threads each)\n";
+
+            std::vector<std::thread> workers;
+            for (int w = 0; w < job_workers; w++)
+                workers.emplace_back([this]() { job_loop(); });
+
+            while (!stopping) {
+                int client = ::accept(listener, nullptr, nullptr);
+                reap_clients();
+                if (client < 0)
+                    continue;
+                std::lock_guard<std::mutex> lock(clients_mutex);
+                clients.emplace(client, std::thread([this, client]() { serve(client); }));
+            }
+
+            ::close(listener);
+            ::unlink(socket_path.c_str());
+            for (auto& w : workers)
+                w.join();
+            fail_queued_jobs();
+
+            // unblock the connections still reading and wait for them, so no client thread
+            // outlives the server
+            std::map<int, std::thread> open;
+            {
+                std::lock_guard<std::mutex> lock(clients_mutex);
+                for (auto& [fd, thread] : clients)
+                    ::shutdown(fd, SHUT_RDWR);
+                open.swap(clients);
+            }
+            for (auto& [fd, thread] : open) {
+                thread.join();
+                ::close(fd);
+            }
+            return 0;
+        }
+
+    private:
+        struct job_order {
+            // highest priority first, then first come first served
+            bool operator()(const shared_ptr<render_job>& a, const shared_ptr<render_job>& b) const {
+                if (a->priority != b->priority)
+                    return a->priority < b->priority;
+                return a->id > b->id;
+            }
+        };
+
+        std::string socket_path;
+        int job_workers;
+        int threads_per_job;
+        scene_cache cache;
+
+        std::mutex mutex;
+        std::condition_variable queue_changed;
+        std::priority_queue<shared_ptr<render_job>, std::vector<shared_ptr<render_job>>, job_order> pending;
+        std::map<int, shared_ptr<render_job>> jobs;     // queued, running and recently finished
+        std::deque<int> finished_ids;                   // oldest first, pruned past max_finished_jobs
+        long long finished_count = 0;
+        double finished_latency = 0;
+        int next_id = 1;
+        std::atomic<bool> stopping{false};
+
+        static constexpr size_t max_finished_jobs = 1000;
+
+        std::mutex clients_mutex;
+        std::map<int, std::thread> clients;             // connection fd -> thread serving it
+        std::vector<int> closed_clients;                // served to the end, waiting to be joined
+
+        void reap_clients() {
+            std::lock_guard<std::mutex> lock(clients_mutex);
+            for (int fd : closed_clients) {
+                clients[fd].join();
+                clients.erase(fd);
+                ::close(fd);
+            }
+            closed_clients.clear();
+        }
+
+        void finish(render_job& job, const std::string& state, const std::string& error) {
+            // caller holds the mutex
+            job.state = state;
+            job.error = error;
+            job.finished = std::chrono::steady_clock::now();
+            finished_count++;
+            finished_latency += seconds(job.submitted, job.finished);
+            finished_ids.push_back(job.id);
+            while (finished_ids.size() > max_finished_jobs) {
+                jobs.erase(finished_ids.front());
+                finished_ids.pop_front();
+            }
+        }
+
+        void fail_queued_jobs() {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!pending.empty())
+                std::clog << "render server: dropping " << pending.size() << " queued jobs\n";
+            while (!pending.empty()) {
+                auto job = pending.top();
+                pending.pop();
+                job->started = std::chrono::steady_clock::now();
+                finish(*job, "failed", "server shut down before the job started");
+            }
+        }
+
+        void request_stop() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            queue_changed.notify_all();
+
+            // wake the accept() in run() so it sees the flag
+            int poke = ::socket(AF_UNIX, SOCK_STREAM, 0);
+            sockaddr_un addr = {};
+            addr.sun_family = AF_UNIX;
+            std::strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+            ::connect(poke, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+            ::close(poke);
+        }
+
+        void job_loop() {
+            while (true) {
+                shared_ptr<render_job> job;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    queue_changed.wait(lock, [this]() { return stopping || !pending.empty(); });
+                    if (stopping)
+                        return;
+                    job = pending.top();
+                    pending.pop();
+                    job->state = "running";
+                    job->started = std::chrono::steady_clock::now();
+                }
+
+                std::string state = "done";
+                std::string error;
+                bool hit = false;
+                try {
+                    execute(*job, hit);
+                } catch (const std::exception& e) {
+                    state = "failed";
+                    error = e.what();
+                }
+
+                std::lock_guard<std::mutex> lock(mutex);
+                job->cache_hit = hit;
+                finish(*job, state, error);
+            }
+        }
+
+        void execute(const render_job& job, bool& cache_hit) {
+            auto scene = cache.get(job.scene, cache_hit);
+
+            camera cam = scene->view;
+            cam.aspect_ratio = 16.0 / 9.0;
+            cam.image_width = 400;
+            cam.thread_count = threads_per_job;
+
+            for (const auto& [key, value] : job.params) {
+                if (key == "lookfrom")      cam.lookfrom = parse_vec3(value);
+                else if (key == "lookat")   cam.lookat = parse_vec3(value);
+                else if (key == "vfov")     cam.vfov = std::stod(value);
+                else if (key == "spp")      cam.samples_per_pixel = std::stoi(value);
+                else if (key == "depth")    cam.max_depth = std::stoi(value);
+                else if (key == "width")    cam.image_width = std::stoi(value);
+                else if (key == "seed")     cam.seed = std::stoull(value);
+                else
+                    throw std::runtime_error("unknown parameter " + key);
+            }
+
+            film image(cam.image_width, cam.get_image_height());
+            cam.render(scene->world, image);
+
+            std::vector<uint32_t> buffer(image.pixel_count());
+            image.resolve(buffer);
+            write_to_ppm(image.width, image.height, buffer, job.output);
+        }
+
+        static vec3 parse_vec3(const std::string& text) {
+            vec3 v;
+            char comma1, comma2;
+            std::istringstream in(text);
+            if (!(in >> v[0] >> comma1 >> v[1] >> comma2 >> v[2]) || comma1 != ',' || comma2 != ',')
+                throw std::runtime_error("bad vector " + text);
+            return v;
+        }
+
+        void serve(int client) {
+            // one command per line until the client hangs up
+            std::string pending_input;
+            char chunk[4096];
+            ssize_t n;
+            while ((n = ::read(client, chunk, sizeof(chunk))) > 0) {
+                pending_input.append(chunk, size_t(n));
+                size_t eol;
+                while ((eol = pending_input.find('\n')) != std::string::npos) {
+                    std::string line = pending_input.substr(0, eol);
+                    pending_input.erase(0, eol + 1);
+                    bool stop = false;
+                    std::string reply = handle(line, stop);
+                    bool sent = ::send(client, reply.data(), reply.size(), MSG_NOSIGNAL) >= 0;
+                    if (stop)
+                        request_stop();     // only after "bye" is on its way
+                    if (!sent)
+                        break;
+                }
+            }
+            // the fd is closed by whoever joins this thread, so it cannot be reused while run()
+            // may still shut it down
+            std::lock_guard<std::mutex> lock(clients_mutex);
+            closed_clients.push_back(client);
+        }
+
+        std::string handle(const std::string& line, bool& stop) {
+            std::istringstream in(line);
+            std::string command;
+            in >> command;
+
+            if (command == "render")
+                return submit(in);
+
+            if (command == "status") {
+                int id = 0;
+                in >> id;
+                std::lock_guard<std::mutex> lock(mutex);
+                auto found = jobs.find(id);
+                if (found == jobs.end())
+                    return "error unknown or expired job\n";
+                return describe(*found->second);
+            }
+
+            if (command == "stats")
+                return stats();
+
+            if (command == "shutdown") {
+                stop = true;
+                return "bye\n";
+            }
+
+            return "error unknown command\n";
+        }
+
+        std::string submit(std::istringstream& in) {
+            auto job = make_shared<render_job>();
+            std::string token;
+            try {
+                while (in >> token) {
+                    auto eq = token.find('=');
+                    if (eq == std::string::npos)
+                        return "error expected key=value, got " + token + "\n";
+                    auto key = token.substr(0, eq);
+                    auto value = token.substr(eq + 1);
+                    if (key == "scene")             job->scene = value;
+                    else if (key == "output")       job->output = value;
+                    else if (key == "priority")     job->priority = std::stoi(value);
+                    else                            job->params[key] = value;
+                }
+            } catch (const std::exception&) {
+                return "error bad value in " + token + "\n";
+            }
+            if (job->scene.empty() || job->output.empty())
+                return "error render needs scene= and output=\n";
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (stopping)
+                return "error server is shutting down\n";
+            job->id = next_id++;
+            job->submitted = std::chrono::steady_clock::now();
+            jobs[job->id] = job;
+            pending.push(job);
+            queue_changed.notify_one();
+            return "queued " + std::to_string(job->id) + "\n";
+        }
+
+        static double seconds(std::chrono::steady_clock::time_point a, std::chrono::steady_clock::time_point b) {
+            return std::chrono::duration<double>(b - a).count();
+        }
+
+        std::string describe(const render_job& job) const {
+            // caller holds the mutex
+            std::ostringstream out;
+            out << job.state << ' ' << job.id << " scene=" << job.scene << " priority=" << job.priority;
+            if (job.state == "done" || job.state == "failed") {
+                out << " wait=" << seconds(job.submitted, job.started)
+                    << " render=" << seconds(job.started, job.finished)
+                    << " latency=" << seconds(job.submitted, job.finished)
+                    << " cache=" << (job.cache_hit ? "hit" : "miss");
+            }
+            if (!job.error.empty())
+                out << " error=\"" << job.error << '"';
+            out << '\n';
+            return out.str();
+        }
+
+        std::string stats() {
+            std::ostringstream out;
+            cache.report(out);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            out << "jobs total=" << next_id - 1 << " queued=" << pending.size() << " finished=" << finished_count
+                << " mean_latency=" << (finished_count > 0 ? finished_latency / finished_count : 0) << '\n';
+            for (const auto& [id, job] : jobs)
+                out << describe(*job);
+            out << "end\n";
+            return out.str();
+        }
+};
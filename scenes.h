@@ -0,0 +1,102 @@
+#pragma once
+
+#include "constants.h"
+#include "hittable_list.h"
+#include "material.h"
+#include "sphere.h"
+#include "render.h"
+
+#include <string>
+#include <vector>
+
+inline void build_default_scene(hittable_list& world) {
+    auto material_ground = make_shared<lambertian>(color(0.8, 0.8, 0.0));
+    auto material_center = make_shared<lambertian>(color(0.1, 0.2, 0.5));
+    auto material_left   = make_shared<dielectric>(1.50);
+    auto material_bubble = make_shared<dielectric>(1.00 / 1.50);
+    auto material_right  = make_shared<metal>(color(0.8, 0.6, 0.2), 1.0);
+
+    world.add(make_shared<sphere>(point3( 0.0, -100.5, -1.0), 100.0, material_ground));
+    world.add(make_shared<sphere>(point3( 0.0,    0.0, -1.2),   0.5, material_center));
+    world.add(make_shared<sphere>(point3(-1.0,    0.0, -1.0),   0.5, material_left));
+    world.add(make_shared<sphere>(point3(-1.0,    0.0, -1.0),   0.4, material_bubble));
+    world.add(make_shared<sphere>(point3( 1.0,    0.0, -1.0),   0.5, material_right));
+}
+
+// Reference scenes for the convergence harness, one per material and one mixing all of them.
+// Each sets up its own camera so results stay comparable across commits.
+inline const std::vector<std::string>& reference_scene_names() {
+    static const std::vector<std::string> names = {"diffuse", "metal", "glass", "mixed", "corridor", "instanced"};
+    return names;
+}
+
+inline bool build_reference_scene(const std::string& name, hittable_list& world, camera& cam) {
+    world.clear();
+    cam.lookfrom = point3(0, 1, 3);
+    cam.lookat = point3(0, 0, -1);
+    cam.vfov = 40;
+    cam.defocus_angle = 0;
+    cam.focus_dist = 1;
+
+    auto ground = make_shared<lambertian>(color(0.5, 0.5, 0.5));
+    world.add(make_shared<sphere>(point3(0, -1000.5, -1), 1000, ground));
+
+    if (name == "diffuse") {
+        // diffuse interreflection between nearby spheres
+        world.add(make_shared<sphere>(point3(-1.1, 0, -1), 0.5, make_shared<lambertian>(color(0.8, 0.3, 0.3))));
+        world.add(make_shared<sphere>(point3( 0.0, 0, -1), 0.5, make_shared<lambertian>(color(0.3, 0.8, 0.3))));
+        world.add(make_shared<sphere>(point3( 1.1, 0, -1), 0.5, make_shared<lambertian>(color(0.3, 0.3, 0.8))));
+    } else if (name == "metal") {
+        world.add(make_shared<sphere>(point3(-1.1, 0, -1), 0.5, make_shared<metal>(color(0.8, 0.8, 0.8), 0.0)));
+        world.add(make_shared<sphere>(point3( 0.0, 0, -1), 0.5, make_shared<metal>(color(0.8, 0.6, 0.2), 0.3)));
+        world.add(make_shared<sphere>(point3( 1.1, 0, -1), 0.5, make_shared<metal>(color(0.6, 0.6, 0.8), 1.0)));
+    } else if (name == "glass") {
+        world.add(make_shared<sphere>(point3(-1.1, 0, -1), 0.5, make_shared<dielectric>(1.5)));
+        world.add(make_shared<sphere>(point3( 0.0, 0, -1), 0.5, make_shared<dielectric>(1.5)));
+        world.add(make_shared<sphere>(point3( 0.0, 0, -1), 0.4, make_shared<dielectric>(1.0 / 1.5)));
+        world.add(make_shared<sphere>(point3( 1.1, 0, -1), 0.5, make_shared<lambertian>(color(0.8, 0.3, 0.3))));
+    } else if (name == "corridor") {
+        // diffuse-dominated: bright walls close on both sides keep paths bouncing for many
+        // diffuse interreflections before they escape to the sky
+        auto wall = make_shared<lambertian>(color(0.8, 0.8, 0.8));
+        world.add(make_shared<sphere>(point3(-1001.2, 0, -1), 1000, wall));
+        world.add(make_shared<sphere>(point3( 1001.2, 0, -1), 1000, wall));
+        world.add(make_shared<sphere>(point3(-0.5, 0, -1.5), 0.5, make_shared<lambertian>(color(0.8, 0.3, 0.3))));
+        world.add(make_shared<sphere>(point3( 0.5, 0, -0.8), 0.5, make_shared<lambertian>(color(0.3, 0.3, 0.8))));
+    } else if (name == "instanced") {
+        // a flat two-triangle floor and a 3x3 grid of one shared sphere cluster, all placed
+        // through instances; the floor has a zero-thickness bounding box
+        world.clear();
+        auto quad = make_shared<triangle_mesh>(
+            mesh_data::from_vectors({-4, 0, -6,  4, 0, -6,  4, 0, 2,  -4, 0, 2}, {0, 2, 1,  0, 3, 2}),
+            make_shared<lambertian>(color(0.5, 0.5, 0.5)));
+        world.add(make_shared<instance>(quad, affine_transform::translate(vec3(0, -0.5, 0))));
+
+        auto cluster = make_shared<hittable_list>();
+        cluster->add(make_shared<sphere>(point3(0, 0, 0), 0.5, make_shared<lambertian>(color(0.8, 0.3, 0.3))));
+        cluster->add(make_shared<sphere>(point3(0.6, -0.3, 0.3), 0.2, make_shared<metal>(color(0.8, 0.8, 0.8), 0.1)));
+        cluster->add(make_shared<sphere>(point3(-0.5, -0.3, 0.4), 0.2, make_shared<dielectric>(1.5)));
+        int instances = 1;
+        for (int i = -1; i <= 1; i++) {
+            for (int j = 0; j < 3; j++) {
+                auto place = affine_transform::translate(vec3(1.3 * i, -0.1, -1 - 1.3 * j))
+                           * affine_transform::rotate(vec3(0, 1, 0), 40.0 * (i + 3 * j))
+                           * affine_transform::scale(0.8);
+                world.add(make_shared<instance>(cluster, place));
+                instances++;
+            }
+        }
+        std::clog << "instanced: " << instances << " instances of " << sizeof(instance) << " bytes, "
+                  << "sharing one " << cluster->objects.size() << "-sphere cluster\n";
+    } else if (name == "mixed") {
+        world.clear();
+        build_default_scene(world);
+        cam.lookfrom = point3(-2, 2, 1);
+        cam.vfov = 20;
+        cam.defocus_angle = 0.6;
+        cam.focus_dist = 3.4;
+    } else {
+        return false;
+    }
+    return true;
+}
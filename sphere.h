@@ -6,14 +6,63 @@
 class sphere : public hittable {
     public:
         sphere(const point3& center, double radius, shared_ptr<material> mat)
-         : center(center), radius(std::fmax(0, radius)), mat(mat) {}
+         : center(center), radius(std::fmax(0, radius)), mat(mat)
+        {
+            auto rvec = vec3(radius, radius, radius);
+            bbox = aabb(center - rvec, center + rvec);
+        }
 
         bool hit(const ray& r, interval ray_t, hit_record&rec) const override {
+            double root;
+            if (!nearest_root(r, ray_t, root))
+                return false;
+
+            rec.t = root;
+            rec.p = r.at(rec.t);
+            vec3 outward_normal = (rec.p - center) / radius;
+            rec.set_face_normal(r, outward_normal);
+            rec.set_normal_angle(r, outward_normal);
+            rec.mat = mat;
+
+            return true;
+        }
+
+        bool hit_any(const ray& r, interval ray_t) const override {
+            double root;
+            return nearest_root(r, ray_t, root);
+        }
+
+        aabb bounding_box() const override { return bbox; }
+    
+    private:
+        point3 center;
+        double radius;
+        shared_ptr<material> mat;   
+        aabb bbox;
+
+        bool nearest_root(const ray& r, interval ray_t, double& root) const {
+            // |direction|^2 comes precomputed with the ray, and is 1 for unit-direction rays,
+            // which then skip the division entirely
             vec3 oc = center - r.origin();
-            auto a = r.direction().length_squared();
             auto h = dot(r.direction(), oc);
             auto c = oc.length_squared() - radius*radius;
-            
+
+            if (r.has_unit_direction()) {
+                auto discriminant = h*h - c;
+                if (discriminant < 0)
+                    return false;
+
+                auto sqrtd = std::sqrt(discriminant);
+                root = h - sqrtd;
+                if (!ray_t.surrounds(root)) {
+                    root = h + sqrtd;
+                    if (!ray_t.surrounds(root))
+                        return false;
+                }
+                return true;
+            }
+
+            auto a = r.length_squared();
             auto discriminant = h*h - a*c;
             if (discriminant < 0){
                 return false;
@@ -22,27 +71,13 @@ class sphere : public hittable {
             auto sqrtd = std::sqrt(discriminant);
 
             // find the nearest root that lies in the acceptable range
-            auto root = (h - sqrtd) / a;
+            root = (h - sqrtd) / a;
             if (!ray_t.surrounds(root)) {
                 root = (h + sqrtd) / a;
                 if (!ray_t.surrounds(root)){
                     return false;
                 }
             }
-
-            rec.t = root;
-            rec.p = r.at(rec.t);
-            vec3 outward_normal = (rec.p - center) / radius;
-            rec.set_face_normal(r, outward_normal);
-            rec.set_normal_angle(r, outward_normal);
-            rec.mat = mat;
-
             return true;
         }
-
-    
-    private:
-        point3 center;
-        double radius;
-        shared_ptr<material> mat;   
 };
@@ -0,0 +1,329 @@
+#pragma once
+
+#include "render.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <chrono>
+#include <deque>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Local tile farm: the coordinator builds the scene once and forks worker processes, which
+// inherit it copy-on-write. Tiles go out and float results come back over one socketpair per
+// worker. Every sample is seeded from (seed, pixel, sample index), so the assembled frame is
+// identical to a single-process render.
+
+struct tile_request {
+    int32_t id;                 // tile index, or -1 to shut the worker down
+    int32_t x0, y0, x1, y1;
+};
+
+struct tile_reply {
+    int32_t id;
+    uint32_t pixel_count;
+    double render_seconds;      // time the worker spent rendering, to separate out transport
+    // followed by float accum[3 * pixel_count], row-major over the tile
+};
+
+struct farm_worker_stats {
+    int tiles = 0;
+    long long samples = 0;
+    double render_seconds = 0;      // reported by the worker
+    double round_trip_seconds = 0;  // request sent to reply received, seen by the coordinator
+    size_t bytes = 0;               // sent plus received
+    bool lost = false;
+};
+
+struct farm_stats {
+    std::vector<farm_worker_stats> workers;
+    int requeued_tiles = 0;
+    int timed_out_tiles = 0;        // tiles whose worker was killed for holding them too long
+    double wall_seconds = 0;
+};
+
+namespace farm_detail {
+    inline bool write_full(int fd, const void* data, size_t size) {
+        const char* p = static_cast<const char*>(data);
+        while (size > 0) {
+            ssize_t n = ::send(fd, p, size, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return false;
+            p += n;
+            size -= size_t(n);
+        }
+        return true;
+    }
+
+    inline bool read_full(int fd, void* data, size_t size) {
+        char* p = static_cast<char*>(data);
+        while (size > 0) {
+            ssize_t n = ::read(fd, p, size);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return false;
+            p += n;
+            size -= size_t(n);
+        }
+        return true;
+    }
+
+    [[noreturn]] inline void worker_main(int fd, const hittable& world, camera cam, int crash_after) {
+        using clock = std::chrono::steady_clock;
+
+        int served = 0;
+
+        tile_request req;
+        while (read_full(fd, &req, sizeof(req)) && req.id >= 0) {
+            if (crash_after >= 0 && served == crash_after)
+                ::_exit(3); // fault injection for exercising the requeue path
+
+            // a film covering just this tile, whose accum is already the reply payload
+            auto start = clock::now();
+            film tile(req.x1 - req.x0, req.y1 - req.y0, req.x0, req.y0);
+            cam.render_region(world, tile, req.x0, req.y0, req.x1, req.y1, cam.samples_per_pixel);
+            const auto& payload = tile.accum;
+
+            tile_reply reply;
+            reply.id = req.id;
+            reply.pixel_count = uint32_t(tile.pixel_count());
+            reply.render_seconds = std::chrono::duration<double>(clock::now() - start).count();
+            if (!write_full(fd, &reply, sizeof(reply))
+                || !write_full(fd, payload.data(), payload.size() * sizeof(float)))
+                break;
+            served++;
+        }
+        ::_exit(0);
+    }
+}
+
+inline farm_stats render_farm(const hittable& world, camera& cam, film& image, int worker_count,
+                              int tile_size, double tile_timeout, int crash_after = -1) {
+    // render `image` to cam.samples_per_pixel with `worker_count` forked workers; tiles held by
+    // a worker that dies, or that does not answer within `tile_timeout` seconds, are put back
+    // on the queue for the others
+    using clock = std::chrono::steady_clock;
+    using namespace farm_detail;
+
+    auto wall_start = clock::now();
+    int width = image.width;
+    int height = image.height;
+
+    std::vector<tile_request> tiles;
+    for (int y = 0; y < height; y += tile_size)
+        for (int x = 0; x < width; x += tile_size)
+            tiles.push_back({int32_t(tiles.size()), x, y, std::min(x + tile_size, width),
+                             std::min(y + tile_size, height)});
+
+    std::deque<int> queue;
+    for (const auto& t : tiles)
+        queue.push_back(t.id);
+
+    // split the hardware threads between the workers unless told otherwise
+    camera worker_cam = cam;
+    if (worker_cam.thread_count <= 0)
+        worker_cam.thread_count = std::max(1, int(std::thread::hardware_concurrency()) / worker_count);
+
+    struct worker {
+        pid_t pid;
+        int fd;
+        int tile = -1;              // outstanding tile, -1 when idle
+        clock::time_point sent;
+        bool alive = true;
+    };
+    std::vector<worker> workers;
+    farm_stats stats;
+    stats.workers.resize(worker_count);
+
+    auto stop_workers = [&]() {
+        // ask every live worker to exit and reap it
+        tile_request shutdown = {-1, 0, 0, 0, 0};
+        for (auto& wk : workers) {
+            if (!wk.alive)
+                continue;
+            write_full(wk.fd, &shutdown, sizeof(shutdown));
+            ::close(wk.fd);
+            ::waitpid(wk.pid, nullptr, 0);
+            wk.alive = false;
+        }
+    };
+
+    for (int w = 0; w < worker_count; w++) {
+        int fds[2];
+        if (::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+            stop_workers();
+            throw std::runtime_error("socketpair failed");
+        }
+
+        pid_t pid = ::fork();
+        if (pid < 0) {
+            ::close(fds[0]);
+            ::close(fds[1]);
+            stop_workers();
+            throw std::runtime_error("fork failed");
+        }
+        if (pid == 0) {
+            ::close(fds[0]);
+            for (const auto& other : workers)
+                ::close(other.fd);
+            worker_main(fds[1], world, worker_cam, w == 0 ? crash_after : -1);
+        }
+        ::close(fds[1]);
+
+        // a worker stalling in the middle of a reply must not block the coordinator's reads
+        timeval limit = {time_t(tile_timeout), suseconds_t((tile_timeout - time_t(tile_timeout)) * 1e6)};
+        ::setsockopt(fds[0], SOL_SOCKET, SO_RCVTIMEO, &limit, sizeof(limit));
+
+        worker wk;
+        wk.pid = pid;
+        wk.fd = fds[0];
+        workers.push_back(wk);
+    }
+
+    auto lose_worker = [&](int w) {
+        auto& wk = workers[w];
+        wk.alive = false;
+        stats.workers[w].lost = true;
+        if (wk.tile >= 0) {
+            queue.push_front(wk.tile);
+            stats.requeued_tiles++;
+            wk.tile = -1;
+        }
+        ::close(wk.fd);
+        ::waitpid(wk.pid, nullptr, 0);
+    };
+
+    auto dispatch = [&](int w) {
+        auto& wk = workers[w];
+        if (!wk.alive || wk.tile >= 0 || queue.empty())
+            return;
+        int id = queue.front();
+        queue.pop_front();
+        wk.tile = id;
+        wk.sent = clock::now();
+        if (!write_full(wk.fd, &tiles[id], sizeof(tile_request)))
+            lose_worker(w);
+        else
+            stats.workers[w].bytes += sizeof(tile_request);
+    };
+
+    size_t remaining = tiles.size();
+    std::vector<float> payload;
+    std::vector<pollfd> fds;
+
+    while (remaining > 0) {
+        for (int w = 0; w < worker_count; w++)
+            dispatch(w);
+
+        fds.clear();
+        std::vector<int> polled;
+        for (int w = 0; w < worker_count; w++) {
+            if (workers[w].alive && workers[w].tile >= 0) {
+                fds.push_back({workers[w].fd, POLLIN, 0});
+                polled.push_back(w);
+            }
+        }
+        if (fds.empty())
+            throw std::runtime_error("all farm workers were lost with tiles outstanding");
+
+        // wait no longer than the earliest tile deadline, then kill workers past theirs
+        auto now = clock::now();
+        double wait = tile_timeout;
+        for (int w : polled)
+            wait = std::min(wait, tile_timeout - std::chrono::duration<double>(now - workers[w].sent).count());
+        if (::poll(fds.data(), fds.size(), int(std::ceil(std::max(0.0, wait) * 1000))) < 0) {
+            if (errno == EINTR)
+                continue;
+            stop_workers();
+            throw std::runtime_error("poll failed");
+        }
+
+        for (size_t k = 0; k < fds.size(); k++) {
+            if (fds[k].revents == 0)
+                continue;
+            int w = polled[k];
+            auto& wk = workers[w];
+
+            tile_reply reply;
+            if (!read_full(wk.fd, &reply, sizeof(reply)) || reply.id != wk.tile) {
+                lose_worker(w);
+                continue;
+            }
+            const auto& t = tiles[reply.id];
+            payload.resize(3 * size_t(reply.pixel_count));
+            if (reply.pixel_count != uint32_t((t.x1 - t.x0) * (t.y1 - t.y0))
+                || !read_full(wk.fd, payload.data(), payload.size() * sizeof(float))) {
+                lose_worker(w);
+                continue;
+            }
+
+            // assemble the tile into the framebuffer
+            size_t src = 0;
+            for (int j = t.y0; j < t.y1; j++) {
+                for (int i = t.x0; i < t.x1; i++) {
+                    size_t index = size_t(j) * width + i;
+                    image.accum[3 * index]     = payload[src++];
+                    image.accum[3 * index + 1] = payload[src++];
+                    image.accum[3 * index + 2] = payload[src++];
+                    image.samples[index] = uint32_t(cam.samples_per_pixel);
+                }
+            }
+
+            auto& ws = stats.workers[w];
+            ws.tiles++;
+            ws.samples += (long long)reply.pixel_count * cam.samples_per_pixel;
+            ws.render_seconds += reply.render_seconds;
+            ws.round_trip_seconds += std::chrono::duration<double>(clock::now() - wk.sent).count();
+            ws.bytes += sizeof(reply) + payload.size() * sizeof(float);
+
+            wk.tile = -1;
+            remaining--;
+        }
+
+        now = clock::now();
+        for (int w : polled) {
+            auto& wk = workers[w];
+            if (wk.alive && wk.tile >= 0
+                && std::chrono::duration<double>(now - wk.sent).count() >= tile_timeout) {
+                std::clog << "farm: worker " << w << " timed out on tile " << wk.tile << '\n';
+                ::kill(wk.pid, SIGKILL);
+                stats.timed_out_tiles++;
+                lose_worker(w);
+            }
+        }
+    }
+
+    stop_workers();
+
+    stats.wall_seconds = std::chrono::duration<double>(clock::now() - wall_start).count();
+    return stats;
+}
+
+inline void print_farm_stats(std::ostream& out, const farm_stats& stats) {
+    // per-worker throughput, plus the share of each round trip not spent rendering
+    // (serialization, socket transfer and time waiting on the coordinator)
+    for (size_t w = 0; w < stats.workers.size(); w++) {
+        const auto& ws = stats.workers[w];
+        double msps = ws.render_seconds > 0 ? ws.samples / ws.render_seconds / 1e6 : 0;
+        double overhead = ws.round_trip_seconds > 0
+                        ? 100.0 * (ws.round_trip_seconds - ws.render_seconds) / ws.round_trip_seconds : 0;
+        out << "worker " << w << ": " << ws.tiles << " tiles, " << msps << " Msamples/s, "
+            << ws.bytes / 1024 << " KiB, " << overhead << "% communication overhead"
+            << (ws.lost ? " (lost)" : "") << '\n';
+    }
+    out << "farm: " << stats.requeued_tiles << " tiles requeued (" << stats.timed_out_tiles << " timed out), "
+        << stats.wall_seconds << " s wall\n";
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include "constants.h"
+#include "aabb.h"
+
+class affine_transform {
+    // affine map x -> m*x + offset, stored as a 3x3 linear part and a translation
+
+    public:
+        double m[3][3];
+        vec3 offset;
+
+        affine_transform() : m{{1, 0, 0}, {0, 1, 0}, {0, 0, 1}}, offset(0, 0, 0) {} // identity
+
+        static affine_transform translate(const vec3& displacement) {
+            affine_transform t;
+            t.offset = displacement;
+            return t;
+        }
+
+        static affine_transform scale(const vec3& factors) {
+            affine_transform t;
+            t.m[0][0] = factors.x();
+            t.m[1][1] = factors.y();
+            t.m[2][2] = factors.z();
+            return t;
+        }
+
+        static affine_transform scale(double factor) {
+            return scale(vec3(factor, factor, factor));
+        }
+
+        static affine_transform rotate(const vec3& axis, double degrees) {
+            // rotation about an axis through the origin (Rodrigues' formula)
+            auto k = unit_vector(axis);
+            auto theta = degrees_to_radians(degrees);
+            auto c = std::cos(theta);
+            auto s = std::sin(theta);
+            auto C = 1 - c;
+
+            affine_transform t;
+            t.m[0][0] = c + k.x()*k.x()*C;
+            t.m[0][1] = k.x()*k.y()*C - k.z()*s;
+            t.m[0][2] = k.x()*k.z()*C + k.y()*s;
+            t.m[1][0] = k.y()*k.x()*C + k.z()*s;
+            t.m[1][1] = c + k.y()*k.y()*C;
+            t.m[1][2] = k.y()*k.z()*C - k.x()*s;
+            t.m[2][0] = k.z()*k.x()*C - k.y()*s;
+            t.m[2][1] = k.z()*k.y()*C + k.x()*s;
+            t.m[2][2] = c + k.z()*k.z()*C;
+            return t;
+        }
+
+        vec3 apply_vector(const vec3& v) const {
+            return vec3(m[0][0]*v[0] + m[0][1]*v[1] + m[0][2]*v[2],
+                        m[1][0]*v[0] + m[1][1]*v[1] + m[1][2]*v[2],
+                        m[2][0]*v[0] + m[2][1]*v[1] + m[2][2]*v[2]);
+        }
+
+        point3 apply_point(const point3& p) const {
+            return apply_vector(p) + offset;
+        }
+
+        vec3 apply_transposed(const vec3& v) const {
+            // multiply by the transpose of the linear part; applying this on the *inverse*
+            // transform maps normals from object to world space
+            return vec3(m[0][0]*v[0] + m[1][0]*v[1] + m[2][0]*v[2],
+                        m[0][1]*v[0] + m[1][1]*v[1] + m[2][1]*v[2],
+                        m[0][2]*v[0] + m[1][2]*v[1] + m[2][2]*v[2]);
+        }
+
+        aabb apply_box(const aabb& box) const {
+            // bounding box of the transformed box, from its eight corners
+            if (box.is_empty())
+                return box;
+
+            point3 lo( infinity,  infinity,  infinity);
+            point3 hi(-infinity, -infinity, -infinity);
+
+            for (int i = 0; i < 2; i++) {
+                for (int j = 0; j < 2; j++) {
+                    for (int k = 0; k < 2; k++) {
+                        auto corner = apply_point(point3(i ? box.x.max : box.x.min,
+                                                         j ? box.y.max : box.y.min,
+                                                         k ? box.z.max : box.z.min));
+                        for (int c = 0; c < 3; c++) {
+                            lo[c] = std::fmin(lo[c], corner[c]);
+                            hi[c] = std::fmax(hi[c], corner[c]);
+                        }
+                    }
+                }
+            }
+            return aabb(lo, hi);
+        }
+
+        affine_transform inverse() const {
+            // invert the linear part via its adjugate, then undo the translation
+            affine_transform inv;
+            auto det = m[0][0] * (m[1][1]*m[2][2] - m[1][2]*m[2][1])
+                     - m[0][1] * (m[1][0]*m[2][2] - m[1][2]*m[2][0])
+                     + m[0][2] * (m[1][0]*m[2][1] - m[1][1]*m[2][0]);
+            auto inv_det = 1.0 / det;
+
+            inv.m[0][0] =  (m[1][1]*m[2][2] - m[1][2]*m[2][1]) * inv_det;
+            inv.m[0][1] = -(m[0][1]*m[2][2] - m[0][2]*m[2][1]) * inv_det;
+            inv.m[0][2] =  (m[0][1]*m[1][2] - m[0][2]*m[1][1]) * inv_det;
+            inv.m[1][0] = -(m[1][0]*m[2][2] - m[1][2]*m[2][0]) * inv_det;
+            inv.m[1][1] =  (m[0][0]*m[2][2] - m[0][2]*m[2][0]) * inv_det;
+            inv.m[1][2] = -(m[0][0]*m[1][2] - m[0][2]*m[1][0]) * inv_det;
+            inv.m[2][0] =  (m[1][0]*m[2][1] - m[1][1]*m[2][0]) * inv_det;
+            inv.m[2][1] = -(m[0][0]*m[2][1] - m[0][1]*m[2][0]) * inv_det;
+            inv.m[2][2] =  (m[0][0]*m[1][1] - m[0][1]*m[1][0]) * inv_det;
+
+            inv.offset = -inv.apply_vector(offset);
+            return inv;
+        }
+};
+
+inline affine_transform operator*(const affine_transform& a, const affine_transform& b) {
+    // composition: (a*b)(x) = a(b(x)), i.e. b is applied first
+    affine_transform t;
+    for (int i = 0; i < 3; i++)
+        for (int j = 0; j < 3; j++)
+            t.m[i][j] = a.m[i][0]*b.m[0][j] + a.m[i][1]*b.m[1][j] + a.m[i][2]*b.m[2][j];
+    t.offset = a.apply_point(b.offset);
+    return t;
+}